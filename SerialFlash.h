@@ -2,11 +2,13 @@
 #define SERIALFLASH_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define SERIALFLASH_PAGE_SIZE 256
 #define SERIALFLASH_SECTOR_SIZE (4 * 1024)
 #define SERIALFLASH_BLOCK_SIZE (64 * 1024)
+#define SERIALFLASH_BLOCK32K_SIZE (32 * 1024)
 
 #define SERIALFLASH_MANUF_ID_ZBIT 0x50
 #define SERIALFLASH_MANUF_ID_WINBOND 0xEF // Winbond Serial Flash
@@ -16,6 +18,16 @@
 #define SERIALFLASH_DEV_ID_Q32 0x15
 #define SERIALFLASH_DEV_ID_Q64 0x16
 #define SERIALFLASH_DEV_ID_Q128 0x17
+#define SERIALFLASH_DEV_ID_Q256 0x18 // Needs 4-byte addressing
+#define SERIALFLASH_DEV_ID_Q512 0x19
+
+#define SERIALFLASH_3BYTE_ADDRESS_LIMIT (16ul * 1024 * 1024)
+
+#define SERIALFLASH_GATHER_CHUNKS_MAX 8 // Chunks per gathered page program
+
+#ifndef SERIALFLASH_VERIFY_CHUNK_SIZE
+#define SERIALFLASH_VERIFY_CHUNK_SIZE 256 // Read size of the streaming checks, on the stack
+#endif
 
 #define SERIALFLASH_CLOCK_FREQ_MAX_MHZ 50
 
@@ -24,6 +36,207 @@
 #define SERIALFLASH_BLOCK32K_ERASE_TIME_MS_MAX 1600
 #define SERIALFLASH_BLOCK64K_ERASE_TIME_MS_MAX 2000
 #define SERIALFLASH_CHIP_ERASE_TIME_MS_MAX (50 * 1000)
+#define SERIALFLASH_WRITE_STATUS_TIME_MS_MAX 15
+
+// Poll period of the modules waiting for a write job, about 1/16 of a typical page program (0.4 ms)
+#ifndef SERIALFLASH_JOB_POLL_US
+#define SERIALFLASH_JOB_POLL_US 25
+#endif
+
+// Embedded operations with their own learned busy time
+enum SerialFlash_Operation {
+    SERIALFLASH_OP_PAGE_PROGRAM = 0,
+    SERIALFLASH_OP_SECTOR_ERASE = 1,
+    SERIALFLASH_OP_BLOCK32K_ERASE = 2,
+    SERIALFLASH_OP_BLOCK64K_ERASE = 3,
+    SERIALFLASH_OP_CHIP_ERASE = 4,
+    SERIALFLASH_OP_WRITE_STATUS = 5,
+    SERIALFLASH_OP_COUNT
+};
+
+// Status registers for the raw byte API
+enum SerialFlash_StatusRegister {
+    SERIALFLASH_SR1 = 0,
+    SERIALFLASH_SR2 = 1,
+    SERIALFLASH_SR3 = 2,
+    SERIALFLASH_SR_COUNT
+};
+
+// Raw status register bits
+#define SERIALFLASH_SR1_BUSY 0x01
+#define SERIALFLASH_SR1_WEL 0x02
+#define SERIALFLASH_SR2_QE 0x02
+#define SERIALFLASH_SR2_SUS 0x80
+
+// Bits the chip changes on its own, never served from the shadow copies
+#define SERIALFLASH_SR1_VOLATILE (SERIALFLASH_SR1_BUSY | SERIALFLASH_SR1_WEL)
+#define SERIALFLASH_SR2_VOLATILE SERIALFLASH_SR2_SUS
+
+enum SerialFlash_BusyPolling {
+    SERIALFLASH_POLL_FIXED = 0, // Read SR1 every 500 us
+    SERIALFLASH_POLL_ADAPTIVE = 1, // Sleep for the learned time, then read SR1 in short steps
+    SERIALFLASH_POLL_CONTINUOUS = 2 // Sleep for the learned time, then read SR1 repeatedly with CS asserted
+};
+
+// Addressing of chips above 16 MB, 3-byte addresses reach only the first 16 MB
+enum SerialFlash_Addressing {
+    SERIALFLASH_ADDRESSING_3BYTE = 0, // Power-up default
+    SERIALFLASH_ADDRESSING_4BYTE_MODE = 1, // Enter 4-Byte Address Mode (0xB7), every address takes 4 bytes
+    SERIALFLASH_ADDRESSING_4BYTE_OPCODES = 2 // Dedicated 4-byte address instructions, the chip stays in 3-byte mode
+};
+
+// Multi-line Fast Read instructions described by SFDP
+enum SerialFlash_ReadMode {
+    SERIALFLASH_READ_1_1_2 = 0, // Dual Output
+    SERIALFLASH_READ_1_2_2 = 1, // Dual I/O
+    SERIALFLASH_READ_1_1_4 = 2, // Quad Output
+    SERIALFLASH_READ_1_4_4 = 3, // Quad I/O
+    SERIALFLASH_READ_MODE_COUNT
+};
+
+enum SerialFlash_AddressModes {
+    SERIALFLASH_ADDRESS_3 = 0, // 3-byte only
+    SERIALFLASH_ADDRESS_3_OR_4 = 1, // 3-byte by default, 4-byte can be entered
+    SERIALFLASH_ADDRESS_4 = 2 // 4-byte only
+};
+
+struct SerialFlash_SfdpRead {
+    bool supported;
+    uint8_t opcode;
+    uint8_t modeClocks;
+    uint8_t dummyClocks;
+};
+
+struct SerialFlash_SfdpErase {
+    uint32_t size; // 0 if the erase type is unused
+    uint8_t opcode;
+    uint32_t typicalMs; // 0 if unknown (JESD216 before revision A)
+    uint32_t maxMs;
+};
+
+// Device descriptor from the SFDP Basic Flash Parameter Table (JESD216)
+struct SerialFlash_Descriptor {
+    bool valid;
+    uint8_t major; // BFPT revision
+    uint8_t minor;
+
+    uint32_t capacity; // Bytes, 0 if above 4 GB
+    uint32_t pageSize;
+    enum SerialFlash_AddressModes addressModes;
+    bool enter4ByteB7; // 4-byte address mode entered with 0xB7 (with or without WREN)
+
+    struct SerialFlash_SfdpErase erase[4];
+    struct SerialFlash_SfdpRead read[SERIALFLASH_READ_MODE_COUNT];
+
+    // 0 if unknown
+    uint32_t pageProgramTypicalUs;
+    uint32_t pageProgramMaxUs;
+    uint32_t chipEraseTypicalMs;
+    uint32_t chipEraseMaxMs;
+};
+
+#ifdef SERIALFLASH_STATS
+// Instrumentation, compiled in when SERIALFLASH_STATS is defined for the whole build.
+// Times come from the platform getTimeUs() clock and stay 0 without one.
+
+#define SERIALFLASH_STATS_BUCKETS 28 // Bucket 0 is 0 us, bucket i holds [2^(i-1), 2^i) us, the last one everything above
+
+enum SerialFlash_StatsOp {
+    SERIALFLASH_STATS_READ = 0, // SerialFlash_Read() transfer
+    SERIALFLASH_STATS_PROGRAM = 1, // Page program command until ready
+    SERIALFLASH_STATS_ERASE = 2, // Erase command until ready
+    SERIALFLASH_STATS_OP_COUNT
+};
+
+enum SerialFlash_TraceEvent {
+    SERIALFLASH_TRACE_BEGIN = 0,
+    SERIALFLASH_TRACE_END = 1
+};
+
+struct SerialFlash_Stats {
+    uint32_t commands[256]; // CS frames per opcode, continuous read frames count as 0xEB/0xEC, mode resets as 0xFF
+    uint64_t bytesWritten; // Bus bytes, opcodes and addresses included, dummy clocks excluded
+    uint64_t bytesRead;
+
+    uint32_t waitBusyCalls; // SerialFlash_WaitBusy() and SerialFlash_WaitBusyOp()
+    uint32_t busyPolls; // SR1 reads within them
+    uint64_t waitBusyUs;
+
+    uint32_t latency[SERIALFLASH_STATS_OP_COUNT][SERIALFLASH_STATS_BUCKETS];
+
+    // Optional, called at the begin and end of every read, program and erase counted above, ok is valid at the end only
+    void (*trace)(void *context, enum SerialFlash_TraceEvent event, enum SerialFlash_StatsOp op,
+        uint32_t address, uint32_t length, bool ok, uint32_t timeUs);
+    void *traceContext;
+};
+
+// Operation between its trace begin and end
+struct SerialFlash_StatsSpan {
+    bool open;
+    enum SerialFlash_StatsOp op;
+    uint32_t address;
+    uint32_t length;
+    uint32_t startUs;
+};
+#endif
+
+// Runtime state of one chip, optional, owned by the caller
+struct SerialFlash_State {
+    enum SerialFlash_BusyPolling polling;
+
+    // Learned typical busy times (moving average), 0 until the first sample
+    uint32_t busyTimeUs[SERIALFLASH_OP_COUNT];
+    uint32_t busySamples[SERIALFLASH_OP_COUNT];
+
+    uint32_t capacity; // Chip size in bytes from SerialFlash_ReadCapacity(), 0 if unknown
+
+    bool quadEnabled; // QE bit as last read from SR2
+    bool continuousRead; // Chip is (or may be) in Quad I/O continuous read mode
+    enum SerialFlash_Addressing addressing; // Set with SerialFlash_SetAddressing()
+    bool skipBlankErase; // SerialFlash_Erase() blank checks every sector first and leaves the blank ones alone
+
+    // Status registers as last read, kept up to date by every status read and dropped on writes and reset.
+    // With shadowStatus set SerialFlash_GetStatus() and SerialFlash_UpdateStatus() use them instead of the chip.
+    bool shadowStatus;
+    uint8_t statusShadow[SERIALFLASH_SR_COUNT];
+    uint8_t statusValid; // Bit per register
+
+    struct SerialFlash_Descriptor descriptor; // From SerialFlash_ReadDescriptor(), used instead of the worst case constants
+
+    // Called before every program/erase command, e.g. to invalidate caches (chip erase passes 0, UINT32_MAX)
+    void (*modifyHook)(void *context, uint32_t address, uint32_t length);
+    void *modifyHookContext;
+
+#ifdef SERIALFLASH_STATS
+    struct SerialFlash_Stats *stats; // Optional, owned by the caller
+#endif
+};
+
+enum SerialFlash_SegmentType {
+    SERIALFLASH_SEGMENT_WRITE = 0, // Sends tx
+    SERIALFLASH_SEGMENT_READ = 1, // Receives into rx
+    SERIALFLASH_SEGMENT_DUMMY = 2 // Dummy clocks, the host drives or releases the lines as it likes
+};
+
+// One phase of a CS frame, length is in bytes over the segment lines
+// (a 2-byte dummy segment over 4 lines is 4 clocks)
+struct SerialFlash_Segment {
+    enum SerialFlash_SegmentType type;
+    int lines; // 1, 2 or 4
+    uint32_t length;
+    const uint8_t *tx;
+    uint8_t *rx;
+};
+
+#define SERIALFLASH_SEGMENT_TX(data, length, lines) { SERIALFLASH_SEGMENT_WRITE, (lines), (length), (data), NULL }
+#define SERIALFLASH_SEGMENT_RX(data, length, lines) { SERIALFLASH_SEGMENT_READ, (lines), (length), NULL, (data) }
+#define SERIALFLASH_SEGMENT_DUMMY_BYTES(length, lines) { SERIALFLASH_SEGMENT_DUMMY, (lines), (length), NULL, NULL }
+
+// Piece of a gathered write
+struct SerialFlash_Chunk {
+    const uint8_t *data;
+    uint32_t length;
+};
 
 struct SerialFlash_Platform {
     // SPI Mode 0 and Mode 3 are supported
@@ -37,9 +250,22 @@ struct SerialFlash_Platform {
 
     void (*spiChipSelect)(bool select);
 
+    // Dual/Quad SPI, optional
+    // Transfers the data over 1, 2 or 4 lines (IO0-IO3), LSB line first, within the current CS frame
+    int dataLines; // Wired data lines: 0 or 1 - standard, 2 - dual, 4 - quad (WP# and HOLD# used as IO2/IO3)
+    int (*spiWriteLines)(const uint8_t *data, uint32_t length, int lines);
+    int (*spiReadLines)(uint8_t *data, uint32_t length, int lines);
+
+    // Scatter-gather transfer, optional, used instead of all the SPI callbacks above when set.
+    // Asserts CS, runs the segments in order and releases CS, e.g. as one DMA descriptor chain.
+    int (*spiTransfer)(const struct SerialFlash_Segment *segments, uint32_t count);
+
     // TODO: add nHOLD, nWP, nRESET support
 
     void (*delayUs)(int us);
+    uint32_t (*getTimeUs)(void); // Free-running microsecond clock, optional, may wrap around
+
+    struct SerialFlash_State *state; // Optional, NULL for stateless operation
 };
 
 enum SerialFlash_StatusRegisterProtect0 {
@@ -115,7 +341,51 @@ struct SerialFlash_StatusRegister3 {
     int wps : 1; // Write Protect Selection
 };
 
-// TODO: SFDP support
+enum SerialFlash_JobType {
+    SERIALFLASH_JOB_ERASE = 0,
+    SERIALFLASH_JOB_WRITE = 1
+};
+
+enum SerialFlash_JobState {
+    SERIALFLASH_JOB_IDLE = 0,
+    SERIALFLASH_JOB_RUNNING = 1,
+    SERIALFLASH_JOB_DONE = 2,
+    SERIALFLASH_JOB_FAILED = 3
+};
+
+// Non-blocking erase/write job, owned by the caller and driven by SerialFlash_PollJob()
+struct SerialFlash_Job {
+    const struct SerialFlash_Platform *platform;
+    enum SerialFlash_JobType type;
+    enum SerialFlash_JobState state;
+
+    uint32_t address; // Next address to erase or program
+    uint32_t end;
+    const uint8_t *buffer; // Next data to program
+
+    // Called once from SerialFlash_PollJob() when the job is finished
+    void (*callback)(struct SerialFlash_Job *job, bool ok);
+    void *context; // User data
+
+#ifdef SERIALFLASH_STATS
+    struct SerialFlash_StatsSpan span; // Command in progress
+#endif
+};
+
+// One command of an erase plan
+struct SerialFlash_EraseStep {
+    uint32_t address;
+    uint32_t size; // SERIALFLASH_SECTOR_SIZE, SERIALFLASH_BLOCK32K_SIZE, SERIALFLASH_BLOCK_SIZE or the whole chip
+};
+
+// Runtime state
+
+void SerialFlash_InitState(struct SerialFlash_State *state, enum SerialFlash_BusyPolling polling);
+uint32_t SerialFlash_GetBusyTimeUs(const struct SerialFlash_Platform *platform, enum SerialFlash_Operation op);
+#ifdef SERIALFLASH_STATS
+// Clears the counters, keeps the trace callback
+void SerialFlash_ResetStats(struct SerialFlash_Stats *stats);
+#endif
 
 // Low level API
 
@@ -127,8 +397,23 @@ bool SerialFlash_ReadUniqueId(const struct SerialFlash_Platform *platform, uint8
 
 bool SerialFlash_ReadData(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
 bool SerialFlash_FastRead(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+bool SerialFlash_FastReadDualOutput(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+bool SerialFlash_FastReadQuadOutput(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+bool SerialFlash_FastReadDualIO(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+bool SerialFlash_FastReadQuadIO(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+
+// Quad I/O continuous read mode (M7-0 = 0x20), needs a state, four data lines and QE set.
+// The first read enters the mode, the following ones send only address and mode bits.
+// Any other command leaves the mode first.
+bool SerialFlash_ContinuousRead(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+bool SerialFlash_ExitContinuousRead(const struct SerialFlash_Platform *platform);
 
 bool SerialFlash_PageProgram(const struct SerialFlash_Platform *platform, uint32_t address, const uint8_t *data, uint32_t length);
+bool SerialFlash_QuadPageProgram(const struct SerialFlash_Platform *platform, uint32_t address, const uint8_t *data, uint32_t length);
+// Programs the chunks back to back within one page, in a single CS frame without copying them.
+// Quad Page Program when four lines are usable. At most SERIALFLASH_GATHER_CHUNKS_MAX chunks.
+bool SerialFlash_PageProgramGather(const struct SerialFlash_Platform *platform, uint32_t address,
+    const struct SerialFlash_Chunk *chunks, uint32_t chunkCount);
 
 bool SerialFlash_SectorErase(const struct SerialFlash_Platform *platform, uint32_t address);
 bool SerialFlash_BlockErase(const struct SerialFlash_Platform *platform, uint32_t address, bool block64k);
@@ -141,17 +426,87 @@ bool SerialFlash_WriteStatusRegister2(const struct SerialFlash_Platform *platfor
 bool SerialFlash_ReadStatusRegister3(const struct SerialFlash_Platform *platform, struct SerialFlash_StatusRegister3 *status3);
 bool SerialFlash_WriteStatusRegister3(const struct SerialFlash_Platform *platform, const struct SerialFlash_StatusRegister3 *status3);
 
+// Raw status register bytes without the struct decoding. Reads always go to the chip and refresh the shadow copy,
+// the write is the plain Write Status Register instruction (needs WEL) and drops it.
+bool SerialFlash_ReadStatus(const struct SerialFlash_Platform *platform, enum SerialFlash_StatusRegister reg, uint8_t *value);
+bool SerialFlash_WriteStatus(const struct SerialFlash_Platform *platform, enum SerialFlash_StatusRegister reg, uint8_t value);
+
 bool SerialFlash_SetGlobalBlockLock(const struct SerialFlash_Platform *platform, bool lock);
 bool SerialFlash_SetBlockLock(const struct SerialFlash_Platform *platform, uint32_t address, bool lock);
 
 bool SerialFlash_Reset(const struct SerialFlash_Platform *platform);
 
+// Enter/Exit 4-Byte Address Mode (0xB7/0xE9), the mode is lost on reset and power cycle
+bool SerialFlash_Enter4ByteAddressMode(const struct SerialFlash_Platform *platform);
+bool SerialFlash_Exit4ByteAddressMode(const struct SerialFlash_Platform *platform);
+
+// Read SFDP Register (0x5A), 3-byte address and 8 dummy clocks in any addressing
+bool SerialFlash_ReadSfdp(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *data, uint32_t length);
+
+// Erase/Program Suspend and Resume, not accepted during status register writes and chip erase
+bool SerialFlash_Suspend(const struct SerialFlash_Platform *platform);
+bool SerialFlash_Resume(const struct SerialFlash_Platform *platform);
+
 // Hight level API
 
 bool SerialFlash_ReadIds(const struct SerialFlash_Platform *platform, char *manufIdStr16, char *devIdStr16, char *uniqueIdStr24);
+bool SerialFlash_ReadCapacity(const struct SerialFlash_Platform *platform, uint32_t *capacity);
+// Parses the SFDP Basic Flash Parameter Table. With a state the descriptor is stored there, sets the capacity
+// and seeds the busy times, so reads, erases, writes and timeouts follow the actual part.
+bool SerialFlash_ReadDescriptor(const struct SerialFlash_Platform *platform, struct SerialFlash_Descriptor *descriptor);
 bool SerialFlash_WaitBusy(const struct SerialFlash_Platform *platform, uint32_t timeout_ms);
+bool SerialFlash_WaitBusyOp(const struct SerialFlash_Platform *platform, enum SerialFlash_Operation op, uint32_t timeout_ms);
+// Needs a state for 4-byte addressing. With SERIALFLASH_ADDRESSING_4BYTE_OPCODES there is no 32K block erase.
+bool SerialFlash_SetAddressing(const struct SerialFlash_Platform *platform, enum SerialFlash_Addressing addressing);
+// Status register from the shadow copy in shadow mode, the volatile bits are then as last read
+bool SerialFlash_GetStatus(const struct SerialFlash_Platform *platform, enum SerialFlash_StatusRegister reg, uint8_t *value);
+// Sets the non-volatile bits in mask to value: write enable, write, wait and verify.
+// Nothing is written if they already match, in shadow mode without touching the bus at all.
+bool SerialFlash_UpdateStatus(const struct SerialFlash_Platform *platform, enum SerialFlash_StatusRegister reg,
+    uint8_t mask, uint8_t value, uint32_t timeout_ms);
+bool SerialFlash_SetQuadEnable(const struct SerialFlash_Platform *platform, bool enable, uint32_t timeout_ms);
 bool SerialFlash_Read(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+// Suspends a running erase/program for the read and resumes it afterwards.
+// The read must not target the sector/page being erased/programmed.
+bool SerialFlash_ReadPreempt(const struct SerialFlash_Platform *platform, uint32_t address, uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+
+// CRC-32 (IEEE 802.3, as zlib), slicing-by-8 over constant 8 KB tables: no first-call init,
+// no RAM cost (they stay in flash) and safe from any thread. Continues from crc, start with 0.
+uint32_t SerialFlash_Crc32(uint32_t crc, const uint8_t *data, uint32_t length);
+// Streaming checks of a flash range, read in SERIALFLASH_VERIFY_CHUNK_SIZE pieces on the stack,
+// no buffer of the range size. Verify stops at the first difference and returns false.
+bool SerialFlash_Checksum(const struct SerialFlash_Platform *platform, uint32_t address, uint32_t length, uint32_t *crc, uint32_t timeout_ms);
+bool SerialFlash_Verify(const struct SerialFlash_Platform *platform, uint32_t address, const uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+bool SerialFlash_VerifyCrc(const struct SerialFlash_Platform *platform, uint32_t address, uint32_t length, uint32_t crc, uint32_t timeout_ms);
+// All bytes 0xFF, compared 32 bytes at a time, stops at the first chunk holding data
+bool SerialFlash_IsBlank(const struct SerialFlash_Platform *platform, uint32_t address, uint32_t length, uint32_t timeout_ms);
 bool SerialFlash_Erase(const struct SerialFlash_Platform *platform, uint32_t address, uint32_t length, uint32_t timeout_ms);
+
+// Cheapest mix of 4K/32K/64K/chip erases covering a sector aligned range, no SPI transfers.
+// Chip erase is considered only when the capacity is known to the state. Up to maxSteps steps are stored (steps may be NULL),
+// stepCount receives the total number of steps and time_ms the estimated worst case time.
+bool SerialFlash_PlanErase(const struct SerialFlash_Platform *platform, uint32_t address, uint32_t length,
+    struct SerialFlash_EraseStep *steps, uint32_t maxSteps, uint32_t *stepCount, uint32_t *time_ms);
 bool SerialFlash_Write(const struct SerialFlash_Platform *platform, uint32_t address, const uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+// Writes the chunks back to back as one range, a page program takes the pieces of up to
+// SERIALFLASH_GATHER_CHUNKS_MAX chunks, so fragmented buffers need no staging copy
+bool SerialFlash_WriteGather(const struct SerialFlash_Platform *platform, uint32_t address,
+    const struct SerialFlash_Chunk *chunks, uint32_t chunkCount, uint32_t timeout_ms);
+
+// Read-modify-write of any range. Sectors that only need 1->0 bit changes are programmed in place,
+// the others are erased and rewritten; pages that already hold the data are skipped.
+// sectorBuffer is SERIALFLASH_SECTOR_SIZE bytes of scratch.
+bool SerialFlash_Update(const struct SerialFlash_Platform *platform, uint32_t address, const uint8_t *buffer, uint32_t length,
+    uint8_t *sectorBuffer, uint32_t timeout_ms);
+
+// Non-blocking API
+// Start functions do no SPI transfers, each poll does one status read and at most one erase/program command.
+// Poll from the main loop or a timer until it returns false, the job must stay valid until then.
+
+bool SerialFlash_StartErase(struct SerialFlash_Job *job, const struct SerialFlash_Platform *platform, uint32_t address, uint32_t length,
+    void (*callback)(struct SerialFlash_Job *job, bool ok), void *context);
+bool SerialFlash_StartWrite(struct SerialFlash_Job *job, const struct SerialFlash_Platform *platform, uint32_t address, const uint8_t *buffer, uint32_t length,
+    void (*callback)(struct SerialFlash_Job *job, bool ok), void *context);
+bool SerialFlash_PollJob(struct SerialFlash_Job *job);
 
 #endif // SERIALFLASH_H
@@ -0,0 +1,295 @@
+// Throughput and latency benchmark of the high-level API on the simulator.
+// Runs a fixed matrix of operations, sizes, alignments, access patterns, SPI clocks and bus widths
+// and prints one record per case. Time is the simulator virtual time, so results are reproducible
+// and only change with the driver or the timing model.
+//
+// Build: cc -std=c99 -O2 SerialFlashBench.c SerialFlash.c SerialFlashSim.c -o SerialFlashBench
+// Usage: SerialFlashBench [--csv] [--quick]
+// Exits with 1 if any operation failed or returned wrong data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SerialFlash.h"
+#include "SerialFlashSim.h"
+
+#define SERIALFLASHBENCH_CAPACITY (4ul * 1024 * 1024)
+#define SERIALFLASHBENCH_CASE_BYTES (1024ul * 1024) // Data moved per case, bounded by the op counts below
+#define SERIALFLASHBENCH_OPS_MIN 16
+#define SERIALFLASHBENCH_OPS_MAX 1024
+#define SERIALFLASHBENCH_TIMEOUT_MS 5000
+#define SERIALFLASHBENCH_SLOT_MIX 0x9E3779B1u // Odd, slot order of the random pattern
+
+enum SerialFlashBench_Op {
+    SERIALFLASHBENCH_READ = 0,
+    SERIALFLASHBENCH_WRITE = 1,
+    SERIALFLASHBENCH_ERASE = 2
+};
+
+enum SerialFlashBench_Pattern {
+    SERIALFLASHBENCH_SEQUENTIAL = 0,
+    SERIALFLASHBENCH_RANDOM = 1, // Every slot at most once, in a scrambled order
+    SERIALFLASHBENCH_APPEND = 2 // Small records back to back, as a log would write them
+};
+
+struct SerialFlashBench_Case {
+    enum SerialFlashBench_Op op;
+    enum SerialFlashBench_Pattern pattern;
+    uint32_t size;
+    uint32_t offset; // From the slot start, 0 for aligned accesses
+    uint32_t clockMhz;
+    int lines;
+};
+
+struct SerialFlashBench_Result {
+    uint32_t ops;
+    uint64_t bytes;
+    uint64_t timeNs;
+    uint64_t p50Ns;
+    uint64_t p99Ns;
+    uint32_t errors;
+};
+
+static const char *const SerialFlashBench_OpNames[] = { "read", "write", "erase" };
+static const char *const SerialFlashBench_PatternNames[] = { "sequential", "random", "append" };
+
+static uint8_t SerialFlashBench_Memory[SERIALFLASHBENCH_CAPACITY];
+static uint8_t SerialFlashBench_Data[SERIALFLASH_BLOCK_SIZE + SERIALFLASH_PAGE_SIZE];
+static uint8_t SerialFlashBench_Buffer[SERIALFLASH_BLOCK_SIZE + SERIALFLASH_PAGE_SIZE];
+static uint64_t SerialFlashBench_Latency[SERIALFLASHBENCH_OPS_MAX];
+
+static int SerialFlashBench_CompareU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest rank
+static uint64_t SerialFlashBench_Percentile(const uint64_t *sorted, uint32_t count, uint32_t percent) {
+    uint32_t rank = (count * percent + 99) / 100;
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Smallest power of two holding an access with its offset, so accesses never overlap
+static uint32_t SerialFlashBench_SlotSize(const struct SerialFlashBench_Case *c) {
+    uint32_t slotSize = 1;
+    while (slotSize < c->size + c->offset) {
+        slotSize <<= 1;
+    }
+
+    return slotSize;
+}
+
+static uint32_t SerialFlashBench_Address(const struct SerialFlashBench_Case *c, uint32_t i) {
+    if (c->pattern == SERIALFLASHBENCH_APPEND) {
+        return c->offset + i * c->size;
+    }
+
+    uint32_t slotSize = SerialFlashBench_SlotSize(c);
+    uint32_t slots = SERIALFLASHBENCH_CAPACITY / slotSize;
+    uint32_t slot = (c->pattern == SERIALFLASHBENCH_RANDOM) ? (i * SERIALFLASHBENCH_SLOT_MIX) & (slots - 1) : i;
+
+    return slot * slotSize + c->offset;
+}
+
+static uint32_t SerialFlashBench_OpCount(const struct SerialFlashBench_Case *c) {
+    uint32_t ops = SERIALFLASHBENCH_CASE_BYTES / c->size;
+    if (ops < SERIALFLASHBENCH_OPS_MIN) {
+        ops = SERIALFLASHBENCH_OPS_MIN;
+    }
+    if (ops > SERIALFLASHBENCH_OPS_MAX) {
+        ops = SERIALFLASHBENCH_OPS_MAX;
+    }
+
+    // Every slot at most once
+    uint32_t slots = SERIALFLASHBENCH_CAPACITY / SerialFlashBench_SlotSize(c);
+    if (c->pattern != SERIALFLASHBENCH_APPEND && ops > slots) {
+        ops = slots;
+    }
+
+    return ops;
+}
+
+static void SerialFlashBench_Run(const struct SerialFlashBench_Case *c, struct SerialFlashBench_Result *result) {
+    // Reads find known data, writes find erased flash
+    memset(SerialFlashBench_Memory, 0xFF, sizeof(SerialFlashBench_Memory));
+    if (c->op == SERIALFLASHBENCH_READ) {
+        for (uint32_t i = 0; i < SERIALFLASHBENCH_CAPACITY; i++) {
+            SerialFlashBench_Memory[i] = (uint8_t)(i * 7 + (i >> 8));
+        }
+    }
+
+    struct SerialFlashSim_Config config;
+    SerialFlashSim_DefaultConfig(&config, SerialFlashBench_Memory, SERIALFLASHBENCH_CAPACITY);
+    config.clockHz = c->clockMhz * 1000000u;
+    SerialFlashSim_Init(&config);
+
+    // The way an application would set the driver up
+    static struct SerialFlash_State state;
+    SerialFlash_InitState(&state, SERIALFLASH_POLL_ADAPTIVE);
+    struct SerialFlash_Platform platform = SerialFlashSim_Platform;
+    platform.dataLines = c->lines;
+    platform.state = &state;
+
+    memset(result, 0, sizeof(*result));
+
+    struct SerialFlash_Descriptor descriptor;
+    if (!SerialFlash_ReadDescriptor(&platform, &descriptor) ||
+        (c->lines == 4 && !SerialFlash_SetQuadEnable(&platform, true, SERIALFLASHBENCH_TIMEOUT_MS))) {
+        result->errors++;
+        return;
+    }
+
+    result->ops = SerialFlashBench_OpCount(c);
+    for (uint32_t i = 0; i < result->ops; i++) {
+        uint32_t address = SerialFlashBench_Address(c, i);
+        uint64_t startNs = SerialFlashSim_GetTimeNs();
+        bool ok;
+
+        switch (c->op) {
+        case SERIALFLASHBENCH_READ:
+            ok = SerialFlash_Read(&platform, address, SerialFlashBench_Buffer, c->size, SERIALFLASHBENCH_TIMEOUT_MS) &&
+                memcmp(SerialFlashBench_Buffer, &SerialFlashBench_Memory[address], c->size) == 0;
+            break;
+        case SERIALFLASHBENCH_WRITE:
+            for (uint32_t j = 0; j < c->size; j++) {
+                SerialFlashBench_Data[j] = (uint8_t)(i + j * 13);
+            }
+            ok = SerialFlash_Write(&platform, address, SerialFlashBench_Data, c->size, SERIALFLASHBENCH_TIMEOUT_MS);
+            break;
+        default:
+            ok = SerialFlash_Erase(&platform, address, c->size, SERIALFLASHBENCH_TIMEOUT_MS);
+            break;
+        }
+
+        SerialFlashBench_Latency[i] = SerialFlashSim_GetTimeNs() - startNs;
+        result->timeNs += SerialFlashBench_Latency[i];
+        result->bytes += c->size;
+        if (!ok) {
+            result->errors++;
+        }
+    }
+
+    // Programs and erases are checked once all are done, the chip must also be idle
+    if (!SerialFlash_WaitBusy(&platform, SERIALFLASHBENCH_TIMEOUT_MS)) {
+        result->errors++;
+    }
+    if (c->op == SERIALFLASHBENCH_WRITE) {
+        for (uint32_t i = 0; i < result->ops; i++) {
+            uint8_t *data = &SerialFlashBench_Memory[SerialFlashBench_Address(c, i)];
+            for (uint32_t j = 0; j < c->size; j++) {
+                if (data[j] != (uint8_t)(i + j * 13)) {
+                    result->errors++;
+                    break;
+                }
+            }
+        }
+    }
+    result->errors += SerialFlashSim_GetStats()->protocolErrors;
+
+    qsort(SerialFlashBench_Latency, result->ops, sizeof(SerialFlashBench_Latency[0]), SerialFlashBench_CompareU64);
+    result->p50Ns = SerialFlashBench_Percentile(SerialFlashBench_Latency, result->ops, 50);
+    result->p99Ns = SerialFlashBench_Percentile(SerialFlashBench_Latency, result->ops, 99);
+}
+
+static void SerialFlashBench_Print(const struct SerialFlashBench_Case *c, const struct SerialFlashBench_Result *r, bool csv) {
+    double seconds = r->timeNs / 1e9;
+    double mbPerS = seconds > 0 ? r->bytes / seconds / 1e6 : 0;
+    double opsPerS = seconds > 0 ? r->ops / seconds : 0;
+
+    if (csv) {
+        printf("%s,%s,%u,%u,%u,%d,%u,%llu,%.3f,%.1f,%.3f,%.3f,%u\n",
+            SerialFlashBench_OpNames[c->op], SerialFlashBench_PatternNames[c->pattern], c->size, c->offset, c->clockMhz, c->lines,
+            r->ops, (unsigned long long)r->bytes, mbPerS, opsPerS, r->p50Ns / 1e3, r->p99Ns / 1e3, r->errors);
+        return;
+    }
+
+    printf("{\"op\":\"%s\",\"pattern\":\"%s\",\"size\":%u,\"offset\":%u,\"clock_mhz\":%u,\"lines\":%d,"
+        "\"ops\":%u,\"bytes\":%llu,\"mb_s\":%.3f,\"ops_s\":%.1f,\"p50_us\":%.3f,\"p99_us\":%.3f,\"errors\":%u}\n",
+        SerialFlashBench_OpNames[c->op], SerialFlashBench_PatternNames[c->pattern], c->size, c->offset, c->clockMhz, c->lines,
+        r->ops, (unsigned long long)r->bytes, mbPerS, opsPerS, r->p50Ns / 1e3, r->p99Ns / 1e3, r->errors);
+}
+
+int main(int argc, char **argv) {
+    bool csv = false;
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--csv] [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static const uint32_t clocksMhz[] = { 12, 25, 50 };
+    static const int lines[] = { 1, 2, 4 };
+    static const uint32_t transferSizes[] = { 16, 256, 4096, 65536 };
+    static const uint32_t recordSizes[] = { 16, 24, 100 };
+    static const uint32_t eraseSizes[] = { SERIALFLASH_SECTOR_SIZE, SERIALFLASH_BLOCK32K_SIZE, SERIALFLASH_BLOCK_SIZE, 4 * SERIALFLASH_BLOCK_SIZE };
+    static const uint32_t offsets[] = { 0, 1 };
+
+    // --quick keeps the fastest clock and the widest bus
+    uint32_t firstSetting = quick ? 2 : 0;
+
+    if (csv) {
+        printf("op,pattern,size,offset,clock_mhz,lines,ops,bytes,mb_s,ops_s,p50_us,p99_us,errors\n");
+    }
+
+    uint32_t failed = 0;
+    for (uint32_t ci = firstSetting; ci < sizeof(clocksMhz) / sizeof(clocksMhz[0]); ci++) {
+        for (uint32_t li = firstSetting; li < sizeof(lines) / sizeof(lines[0]); li++) {
+            struct SerialFlashBench_Case c = { 0 };
+            c.clockMhz = clocksMhz[ci];
+            c.lines = lines[li];
+
+            struct SerialFlashBench_Case cases[64];
+            uint32_t count = 0;
+
+            for (int op = SERIALFLASHBENCH_READ; op <= SERIALFLASHBENCH_WRITE; op++) {
+                for (int pattern = SERIALFLASHBENCH_SEQUENTIAL; pattern <= SERIALFLASHBENCH_RANDOM; pattern++) {
+                    for (uint32_t si = 0; si < sizeof(transferSizes) / sizeof(transferSizes[0]); si++) {
+                        for (uint32_t oi = 0; oi < sizeof(offsets) / sizeof(offsets[0]); oi++) {
+                            c.op = (enum SerialFlashBench_Op)op;
+                            c.pattern = (enum SerialFlashBench_Pattern)pattern;
+                            c.size = transferSizes[si];
+                            c.offset = offsets[oi];
+                            cases[count++] = c;
+                        }
+                    }
+                }
+            }
+
+            for (uint32_t si = 0; si < sizeof(recordSizes) / sizeof(recordSizes[0]); si++) {
+                c.op = SERIALFLASHBENCH_WRITE;
+                c.pattern = SERIALFLASHBENCH_APPEND;
+                c.size = recordSizes[si];
+                c.offset = 0;
+                cases[count++] = c;
+            }
+
+            for (int pattern = SERIALFLASHBENCH_SEQUENTIAL; pattern <= SERIALFLASHBENCH_RANDOM; pattern++) {
+                for (uint32_t si = 0; si < sizeof(eraseSizes) / sizeof(eraseSizes[0]); si++) {
+                    c.op = SERIALFLASHBENCH_ERASE;
+                    c.pattern = (enum SerialFlashBench_Pattern)pattern;
+                    c.size = eraseSizes[si];
+                    c.offset = 0;
+                    cases[count++] = c;
+                }
+            }
+
+            for (uint32_t i = 0; i < count; i++) {
+                struct SerialFlashBench_Result result;
+                SerialFlashBench_Run(&cases[i], &result);
+                SerialFlashBench_Print(&cases[i], &result, csv);
+                failed += result.errors != 0;
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}
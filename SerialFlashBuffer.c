@@ -0,0 +1,160 @@
+#include "SerialFlashBuffer.h"
+
+#include <string.h>
+
+void SerialFlashBuffer_Init(struct SerialFlashBuffer *buffer, const struct SerialFlash_Platform *platform,
+    uint32_t (*getTimeMs)(void), uint32_t maxDelayMs) {
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->platform = platform;
+    buffer->getTimeMs = getTimeMs;
+    buffer->maxDelayMs = maxDelayMs;
+    buffer->pageAddress = SERIALFLASHBUFFER_EMPTY;
+}
+
+static bool SerialFlashBuffer_WaitJob(struct SerialFlashBuffer *buffer, uint32_t timeout_ms) {
+    uint32_t timeoutUs = timeout_ms * 1000;
+
+    for (uint32_t elapsedUs = 0; SerialFlash_PollJob(&buffer->job); elapsedUs += SERIALFLASH_JOB_POLL_US) {
+        if (elapsedUs >= timeoutUs) {
+            return false;
+        }
+
+        buffer->platform->delayUs(SERIALFLASH_JOB_POLL_US);
+    }
+
+    // Reported once, the next flush starts a new job
+    if (buffer->job.state == SERIALFLASH_JOB_FAILED) {
+        buffer->job.state = SERIALFLASH_JOB_IDLE;
+        return false;
+    }
+
+    return true;
+}
+
+bool SerialFlashBuffer_Flush(struct SerialFlashBuffer *buffer, uint32_t timeout_ms) {
+    if (buffer->pageAddress == SERIALFLASHBUFFER_EMPTY) {
+        return true;
+    }
+
+    // Only one program can be in flight
+    if (!SerialFlashBuffer_WaitJob(buffer, timeout_ms)) {
+        return false;
+    }
+
+    SerialFlash_StartWrite(&buffer->job, buffer->platform, buffer->pageAddress + buffer->dirtyStart,
+        buffer->page + buffer->dirtyStart, buffer->dirtyEnd - buffer->dirtyStart, NULL, NULL);
+    buffer->programs++;
+
+    // The page goes out in one poll once the chip is idle. Until then it stays pending:
+    // reads merge it and writes don't reuse the image the job programs from.
+    uint32_t timeoutUs = timeout_ms * 1000;
+    for (uint32_t elapsedUs = 0; SerialFlash_PollJob(&buffer->job); elapsedUs += SERIALFLASH_JOB_POLL_US) {
+        if (buffer->job.address >= buffer->job.end) {
+            buffer->pageAddress = SERIALFLASHBUFFER_EMPTY;
+            return true;
+        }
+        if (elapsedUs >= timeoutUs) {
+            return false;
+        }
+
+        buffer->platform->delayUs(SERIALFLASH_JOB_POLL_US);
+    }
+
+    // Failed before the program went out, the next flush retries the page
+    buffer->job.state = SERIALFLASH_JOB_IDLE;
+    return false;
+}
+
+bool SerialFlashBuffer_Barrier(struct SerialFlashBuffer *buffer, uint32_t timeout_ms) {
+    if (!SerialFlashBuffer_Flush(buffer, timeout_ms)) {
+        return false;
+    }
+
+    return SerialFlashBuffer_WaitJob(buffer, timeout_ms);
+}
+
+bool SerialFlashBuffer_Poll(struct SerialFlashBuffer *buffer, uint32_t timeout_ms) {
+    if (buffer->pageAddress == SERIALFLASHBUFFER_EMPTY || !buffer->getTimeMs || !buffer->maxDelayMs) {
+        return true;
+    }
+
+    if (buffer->getTimeMs() - buffer->pendingSinceMs < buffer->maxDelayMs) {
+        return true;
+    }
+
+    return SerialFlashBuffer_Flush(buffer, timeout_ms);
+}
+
+bool SerialFlashBuffer_Write(struct SerialFlashBuffer *buffer, uint32_t address, const uint8_t *data, uint32_t length, uint32_t timeout_ms) {
+    buffer->writes++;
+
+    while (length > 0) {
+        uint32_t pageAddress = address - address % SERIALFLASH_PAGE_SIZE;
+        uint32_t offset = address - pageAddress;
+        uint32_t chunk = SERIALFLASH_PAGE_SIZE - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        if (buffer->pageAddress != pageAddress) {
+            if (!SerialFlashBuffer_Flush(buffer, timeout_ms)) {
+                return false;
+            }
+
+            memset(buffer->page, 0xFF, sizeof(buffer->page));
+            buffer->pageAddress = pageAddress;
+            buffer->dirtyStart = offset;
+            buffer->dirtyEnd = offset + chunk;
+            buffer->pendingSinceMs = buffer->getTimeMs ? buffer->getTimeMs() : 0;
+        }
+
+        // Programming can only clear bits
+        for (uint32_t i = 0; i < chunk; i++) {
+            buffer->page[offset + i] &= data[i];
+        }
+        if (offset < buffer->dirtyStart) {
+            buffer->dirtyStart = offset;
+        }
+        if (offset + chunk > buffer->dirtyEnd) {
+            buffer->dirtyEnd = offset + chunk;
+        }
+
+        // Sequential writers fill pages to the end, nothing more will come for this one
+        if (offset + chunk == SERIALFLASH_PAGE_SIZE && !SerialFlashBuffer_Flush(buffer, timeout_ms)) {
+            return false;
+        }
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+
+    return SerialFlashBuffer_Poll(buffer, timeout_ms);
+}
+
+bool SerialFlashBuffer_Read(struct SerialFlashBuffer *buffer, uint32_t address, uint8_t *data, uint32_t length, uint32_t timeout_ms) {
+    // SerialFlash_Read() waits for the program in flight
+    if (!SerialFlash_Read(buffer->platform, address, data, length, timeout_ms)) {
+        return false;
+    }
+
+    if (buffer->pageAddress == SERIALFLASHBUFFER_EMPTY) {
+        return true;
+    }
+
+    // Overlap with the pending range
+    uint32_t start = buffer->pageAddress + buffer->dirtyStart;
+    uint32_t end = buffer->pageAddress + buffer->dirtyEnd;
+    if (start < address) {
+        start = address;
+    }
+    if (end > address + length) {
+        end = address + length;
+    }
+
+    for (uint32_t a = start; a < end; a++) {
+        data[a - address] &= buffer->page[a - buffer->pageAddress];
+    }
+
+    return true;
+}
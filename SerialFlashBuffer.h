@@ -0,0 +1,48 @@
+#ifndef SERIALFLASHBUFFER_H
+#define SERIALFLASHBUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Write-back buffer that gathers small writes into one page program.
+// Data is ANDed into a page image (NOR semantics, as SerialFlash_Write), a page is flushed
+// when a write leaves it, reaches its end, or stays pending longer than maxDelayMs.
+// Flush only starts the program, so the next records are gathered while the chip is busy.
+
+struct SerialFlashBuffer {
+    const struct SerialFlash_Platform *platform;
+
+    uint32_t (*getTimeMs)(void); // Optional, enables maxDelayMs
+    uint32_t maxDelayMs; // 0 to flush only on page change/end, flush and barrier
+
+    uint32_t pageAddress; // SERIALFLASHBUFFER_EMPTY if nothing is pending
+    uint32_t dirtyStart; // Pending range within the page
+    uint32_t dirtyEnd;
+    uint32_t pendingSinceMs;
+    uint8_t page[SERIALFLASH_PAGE_SIZE];
+
+    struct SerialFlash_Job job; // Program in flight
+
+    uint32_t writes; // SerialFlashBuffer_Write() calls
+    uint32_t programs; // Page programs issued
+};
+
+#define SERIALFLASHBUFFER_EMPTY UINT32_MAX
+
+void SerialFlashBuffer_Init(struct SerialFlashBuffer *buffer, const struct SerialFlash_Platform *platform,
+    uint32_t (*getTimeMs)(void), uint32_t maxDelayMs);
+
+// Target range must be erased, as for SerialFlash_Write()
+bool SerialFlashBuffer_Write(struct SerialFlashBuffer *buffer, uint32_t address, const uint8_t *data, uint32_t length, uint32_t timeout_ms);
+// Reads the chip with pending data applied
+bool SerialFlashBuffer_Read(struct SerialFlashBuffer *buffer, uint32_t address, uint8_t *data, uint32_t length, uint32_t timeout_ms);
+
+// Starts programming the pending page, it stays pending until the program command is sent
+bool SerialFlashBuffer_Flush(struct SerialFlashBuffer *buffer, uint32_t timeout_ms);
+// Flushes and waits until everything written so far is on the chip
+bool SerialFlashBuffer_Barrier(struct SerialFlashBuffer *buffer, uint32_t timeout_ms);
+// Flushes the pending page if it is older than maxDelayMs, call periodically
+bool SerialFlashBuffer_Poll(struct SerialFlashBuffer *buffer, uint32_t timeout_ms);
+
+#endif // SERIALFLASHBUFFER_H
@@ -0,0 +1,183 @@
+#include "SerialFlashCache.h"
+
+#include <string.h>
+
+static void SerialFlashCache_ModifyHook(void *context, uint32_t address, uint32_t length) {
+    struct SerialFlashCache *cache = (struct SerialFlashCache *)context;
+    SerialFlashCache_Invalidate(cache, address, length);
+
+    if (cache->nextHook) {
+        cache->nextHook(cache->nextHookContext, address, length);
+    }
+}
+
+bool SerialFlashCache_Init(struct SerialFlashCache *cache, const struct SerialFlash_Platform *platform,
+    enum SerialFlashCache_Policy policy, uint32_t lineSize, void *pool, size_t poolSize) {
+    // Line size must be a power of two so lines never straddle a sector
+    if (lineSize == 0 || (lineSize & (lineSize - 1)) || lineSize > SERIALFLASH_SECTOR_SIZE) {
+        return false;
+    }
+
+    size_t lineCount = poolSize / (lineSize + sizeof(struct SerialFlashCache_Line));
+    if (lineCount == 0) {
+        return false;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    cache->platform = platform;
+    cache->policy = policy;
+    cache->lineSize = lineSize;
+    cache->lineCount = (uint32_t)lineCount;
+    cache->lines = (struct SerialFlashCache_Line *)pool;
+    cache->data = (uint8_t *)pool + lineCount * sizeof(struct SerialFlashCache_Line);
+
+    SerialFlashCache_InvalidateAll(cache);
+
+    // Chained in front of a hook already installed (e.g. another cache)
+    if (platform->state) {
+        cache->nextHook = platform->state->modifyHook;
+        cache->nextHookContext = platform->state->modifyHookContext;
+        platform->state->modifyHook = SerialFlashCache_ModifyHook;
+        platform->state->modifyHookContext = cache;
+    }
+
+    return true;
+}
+
+void SerialFlashCache_Deinit(struct SerialFlashCache *cache) {
+    struct SerialFlash_State *state = cache->platform->state;
+    if (!state) {
+        return;
+    }
+
+    if (state->modifyHook == SerialFlashCache_ModifyHook && state->modifyHookContext == cache) {
+        state->modifyHook = cache->nextHook;
+        state->modifyHookContext = cache->nextHookContext;
+        return;
+    }
+
+    // Unlink from the caches chained in front of it
+    void (*hook)(void *context, uint32_t address, uint32_t length) = state->modifyHook;
+    struct SerialFlashCache *prev = state->modifyHookContext;
+    while (hook == SerialFlashCache_ModifyHook) {
+        if (prev->nextHook == SerialFlashCache_ModifyHook && prev->nextHookContext == cache) {
+            prev->nextHook = cache->nextHook;
+            prev->nextHookContext = cache->nextHookContext;
+            return;
+        }
+
+        hook = prev->nextHook;
+        prev = prev->nextHookContext;
+    }
+}
+
+static struct SerialFlashCache_Line *SerialFlashCache_Find(struct SerialFlashCache *cache, uint32_t lineAddress) {
+    for (uint32_t i = 0; i < cache->lineCount; i++) {
+        if (cache->lines[i].address == lineAddress) {
+            return &cache->lines[i];
+        }
+    }
+
+    return NULL;
+}
+
+static struct SerialFlashCache_Line *SerialFlashCache_Victim(struct SerialFlashCache *cache) {
+    if (cache->policy == SERIALFLASHCACHE_CLOCK) {
+        // Sweep the hand, giving referenced lines a second chance
+        for (;;) {
+            struct SerialFlashCache_Line *line = &cache->lines[cache->tick];
+            cache->tick = (cache->tick + 1) % cache->lineCount;
+
+            if (line->address == SERIALFLASHCACHE_INVALID || !line->used) {
+                return line;
+            }
+            line->used = 0;
+        }
+    }
+
+    // Oldest use, empty lines first; ages are differences so the tick may wrap
+    struct SerialFlashCache_Line *victim = &cache->lines[0];
+    for (uint32_t i = 0; i < cache->lineCount; i++) {
+        struct SerialFlashCache_Line *line = &cache->lines[i];
+
+        if (line->address == SERIALFLASHCACHE_INVALID) {
+            return line;
+        }
+        if (cache->tick - line->used > cache->tick - victim->used) {
+            victim = line;
+        }
+    }
+
+    return victim;
+}
+
+static void SerialFlashCache_Touch(struct SerialFlashCache *cache, struct SerialFlashCache_Line *line) {
+    if (cache->policy == SERIALFLASHCACHE_CLOCK) {
+        line->used = 1;
+    } else {
+        line->used = cache->tick++;
+    }
+}
+
+bool SerialFlashCache_Read(struct SerialFlashCache *cache, uint32_t address, uint8_t *buffer, uint32_t length, uint32_t timeout_ms) {
+    while (length > 0) {
+        uint32_t lineAddress = address & ~(cache->lineSize - 1);
+        uint32_t offset = address - lineAddress;
+        uint32_t chunk = cache->lineSize - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        struct SerialFlashCache_Line *line = SerialFlashCache_Find(cache, lineAddress);
+        uint8_t *data;
+
+        if (line) {
+            cache->hits++;
+            data = cache->data + (line - cache->lines) * cache->lineSize;
+        } else {
+            cache->misses++;
+            line = SerialFlashCache_Victim(cache);
+            data = cache->data + (line - cache->lines) * cache->lineSize;
+
+            line->address = SERIALFLASHCACHE_INVALID;
+            if (!SerialFlash_Read(cache->platform, lineAddress, data, cache->lineSize, timeout_ms)) {
+                return false;
+            }
+            line->address = lineAddress;
+        }
+
+        SerialFlashCache_Touch(cache, line);
+        memcpy(buffer, data + offset, chunk);
+
+        address += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+
+    return true;
+}
+
+void SerialFlashCache_Invalidate(struct SerialFlashCache *cache, uint32_t address, uint32_t length) {
+    uint64_t end = (uint64_t)address + length;
+
+    for (uint32_t i = 0; i < cache->lineCount; i++) {
+        struct SerialFlashCache_Line *line = &cache->lines[i];
+
+        if (line->address != SERIALFLASHCACHE_INVALID &&
+            line->address < end && (uint64_t)line->address + cache->lineSize > address) {
+            line->address = SERIALFLASHCACHE_INVALID;
+        }
+    }
+}
+
+void SerialFlashCache_InvalidateAll(struct SerialFlashCache *cache) {
+    for (uint32_t i = 0; i < cache->lineCount; i++) {
+        cache->lines[i].address = SERIALFLASHCACHE_INVALID;
+        cache->lines[i].used = 0;
+    }
+}
+
+void SerialFlashCache_ResetStats(struct SerialFlashCache *cache) {
+    cache->hits = 0;
+    cache->misses = 0;
+}
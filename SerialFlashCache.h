@@ -0,0 +1,59 @@
+#ifndef SERIALFLASHCACHE_H
+#define SERIALFLASHCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Read cache above SerialFlash_Read() with page or sector sized lines in a caller-supplied pool.
+// With a platform state the cache installs its modify hook there, so program/erase commands
+// invalidate the lines they touch. Without one, call SerialFlashCache_Invalidate() after writes.
+// A hook already installed (another cache, a user hook) is chained and still called.
+
+enum SerialFlashCache_Policy {
+    SERIALFLASHCACHE_LRU = 0, // Evict the least recently used line
+    SERIALFLASHCACHE_CLOCK = 1 // Second chance, cheaper bookkeeping on hits
+};
+
+struct SerialFlashCache_Line {
+    uint32_t address; // SERIALFLASHCACHE_INVALID if empty
+    uint32_t used; // LRU: last use tick, CLOCK: referenced flag
+};
+
+#define SERIALFLASHCACHE_INVALID UINT32_MAX
+
+struct SerialFlashCache {
+    const struct SerialFlash_Platform *platform;
+    enum SerialFlashCache_Policy policy;
+
+    uint32_t lineSize; // SERIALFLASH_PAGE_SIZE or SERIALFLASH_SECTOR_SIZE
+    uint32_t lineCount;
+    struct SerialFlashCache_Line *lines;
+    uint8_t *data; // lineCount * lineSize
+
+    uint32_t tick; // LRU: use counter, CLOCK: hand
+
+    // Modify hook installed before this cache, called after invalidating
+    void (*nextHook)(void *context, uint32_t address, uint32_t length);
+    void *nextHookContext;
+
+    uint32_t hits; // Line lookups served from the cache
+    uint32_t misses; // Line lookups read from the chip
+};
+
+// Bytes of pool needed for lineCount lines
+#define SERIALFLASHCACHE_POOL_SIZE(lineSize, lineCount) ((size_t)(lineCount) * ((lineSize) + sizeof(struct SerialFlashCache_Line)))
+
+// Pool must be aligned for uint32_t, returns false if it can't hold a single line
+bool SerialFlashCache_Init(struct SerialFlashCache *cache, const struct SerialFlash_Platform *platform,
+    enum SerialFlashCache_Policy policy, uint32_t lineSize, void *pool, size_t poolSize);
+// Removes the modify hook from the platform state, the chained hook stays installed
+void SerialFlashCache_Deinit(struct SerialFlashCache *cache);
+
+bool SerialFlashCache_Read(struct SerialFlashCache *cache, uint32_t address, uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+void SerialFlashCache_Invalidate(struct SerialFlashCache *cache, uint32_t address, uint32_t length);
+void SerialFlashCache_InvalidateAll(struct SerialFlashCache *cache);
+void SerialFlashCache_ResetStats(struct SerialFlashCache *cache);
+
+#endif // SERIALFLASHCACHE_H
@@ -0,0 +1,385 @@
+#include "SerialFlashFTL.h"
+
+#include <string.h>
+#include "BitOps.h"
+
+// Checkpoint: header {magic, seq, blockCount, sectorCount}, map (u16 each), erase counts (u32 each),
+// the header is programmed last and commits it. Journal entries fill the rest of the area.
+#define SERIALFLASHFTL_HEADER_SIZE 16
+#define SERIALFLASHFTL_JOURNAL_SECTORS 1 // At least, per area
+#define SERIALFLASHFTL_ENTRY_SIZE 12 // {u16 logical, u16 physical, u32 eraseCount, u32 check}
+
+static void SerialFlashFTL_PutU32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t SerialFlashFTL_EntryCheck(uint16_t logical, uint16_t physical, uint32_t eraseCount) {
+    return ~((uint32_t)logical | (uint32_t)physical << 16) ^ eraseCount;
+}
+
+static uint32_t SerialFlashFTL_AreaAddress(const struct SerialFlashFTL *ftl, uint32_t area) {
+    return area * ftl->areaSectors * SERIALFLASH_SECTOR_SIZE;
+}
+
+static uint32_t SerialFlashFTL_SectorAddress(const struct SerialFlashFTL *ftl, uint32_t sector) {
+    return ftl->dataBase + sector * SERIALFLASH_SECTOR_SIZE;
+}
+
+static uint32_t SerialFlashFTL_JournalStart(const struct SerialFlashFTL *ftl, uint32_t area) {
+    return SerialFlashFTL_AreaAddress(ftl, area) + SERIALFLASHFTL_HEADER_SIZE + ftl->blockCount * 2 + ftl->sectorCount * 4;
+}
+
+static bool SerialFlashFTL_Start(struct SerialFlashFTL *ftl, const struct SerialFlash_Platform *platform,
+    uint16_t *map, struct SerialFlashFTL_Sector *sectors, uint32_t arraySize, uint32_t spareSectors,
+    uint32_t staticThreshold) {
+    uint32_t capacity;
+    if (!SerialFlash_ReadCapacity(platform, &capacity)) {
+        return false;
+    }
+
+    // Checkpoint sized for the whole chip, a bit more than needed
+    uint32_t total = capacity / SERIALFLASH_SECTOR_SIZE;
+    uint32_t checkpointSize = SERIALFLASHFTL_HEADER_SIZE + total * (2 + 4);
+    uint32_t areaSectors = (checkpointSize + SERIALFLASH_SECTOR_SIZE - 1) / SERIALFLASH_SECTOR_SIZE + SERIALFLASHFTL_JOURNAL_SECTORS;
+
+    if (spareSectors == 0 || total <= 2 * areaSectors + spareSectors ||
+        total - 2 * areaSectors > arraySize || total - 2 * areaSectors >= SERIALFLASHFTL_UNMAPPED) {
+        return false;
+    }
+
+    memset(ftl, 0, sizeof(*ftl));
+    ftl->platform = platform;
+    ftl->map = map;
+    ftl->sectors = sectors;
+    ftl->areaSectors = areaSectors;
+    ftl->sectorCount = total - 2 * areaSectors;
+    ftl->blockCount = ftl->sectorCount - spareSectors;
+    ftl->dataBase = 2 * areaSectors * SERIALFLASH_SECTOR_SIZE;
+    ftl->staticThreshold = staticThreshold;
+
+    return true;
+}
+
+// Programs values of 2 or 4 bytes through a page buffer
+static bool SerialFlashFTL_WriteTable(const struct SerialFlashFTL *ftl, uint32_t address, bool counts, uint32_t timeout_ms) {
+    uint8_t page[SERIALFLASH_PAGE_SIZE];
+    uint32_t fill = 0;
+    uint32_t count = counts ? ftl->sectorCount : ftl->blockCount;
+    uint32_t size = counts ? 4 : 2;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (counts) {
+            SerialFlashFTL_PutU32(page + fill, ftl->sectors[i].eraseCount);
+        } else {
+            page[fill] = (uint8_t)ftl->map[i];
+            page[fill + 1] = (uint8_t)(ftl->map[i] >> 8);
+        }
+        fill += size;
+
+        if (fill == sizeof(page) || i == count - 1) {
+            if (!SerialFlash_Write(ftl->platform, address, page, fill, timeout_ms)) {
+                return false;
+            }
+            address += fill;
+            fill = 0;
+        }
+    }
+
+    return true;
+}
+
+static bool SerialFlashFTL_ReadTable(struct SerialFlashFTL *ftl, uint32_t address, bool counts, uint32_t timeout_ms) {
+    uint8_t page[SERIALFLASH_PAGE_SIZE];
+    uint32_t count = counts ? ftl->sectorCount : ftl->blockCount;
+    uint32_t size = counts ? 4 : 2;
+
+    for (uint32_t i = 0; i < count; i += sizeof(page) / size) {
+        uint32_t n = count - i < sizeof(page) / size ? count - i : sizeof(page) / size;
+
+        if (!SerialFlash_Read(ftl->platform, address + i * size, page, n * size, timeout_ms)) {
+            return false;
+        }
+
+        for (uint32_t k = 0; k < n; k++) {
+            if (counts) {
+                ftl->sectors[i + k].eraseCount = (uint32_t)BITOPS_READ_U32L(page + k * 4);
+            } else {
+                ftl->map[i + k] = (uint16_t)BITOPS_READ_U16L(page + k * 2);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool SerialFlashFTL_Checkpoint(struct SerialFlashFTL *ftl, uint32_t timeout_ms) {
+    uint32_t area = ftl->area ^ 1;
+    uint32_t address = SerialFlashFTL_AreaAddress(ftl, area);
+
+    if (!SerialFlash_Erase(ftl->platform, address, ftl->areaSectors * SERIALFLASH_SECTOR_SIZE, timeout_ms) ||
+        !SerialFlashFTL_WriteTable(ftl, address + SERIALFLASHFTL_HEADER_SIZE, false, timeout_ms) ||
+        !SerialFlashFTL_WriteTable(ftl, address + SERIALFLASHFTL_HEADER_SIZE + ftl->blockCount * 2, true, timeout_ms)) {
+        return false;
+    }
+
+    uint8_t header[SERIALFLASHFTL_HEADER_SIZE];
+    SerialFlashFTL_PutU32(header, SERIALFLASHFTL_MAGIC);
+    SerialFlashFTL_PutU32(header + 4, ftl->seq + 1);
+    SerialFlashFTL_PutU32(header + 8, ftl->blockCount);
+    SerialFlashFTL_PutU32(header + 12, ftl->sectorCount);
+    if (!SerialFlash_Write(ftl->platform, address, header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    ftl->area = area;
+    ftl->seq++;
+    ftl->journalAddress = SerialFlashFTL_JournalStart(ftl, area);
+    ftl->journalEnd = address + ftl->areaSectors * SERIALFLASH_SECTOR_SIZE;
+    ftl->checkpoints++;
+
+    return true;
+}
+
+// Records a remap already applied in RAM
+static bool SerialFlashFTL_Journal(struct SerialFlashFTL *ftl, uint16_t logical, uint16_t physical, uint32_t timeout_ms) {
+    if (ftl->journalAddress + SERIALFLASHFTL_ENTRY_SIZE > ftl->journalEnd) {
+        return SerialFlashFTL_Checkpoint(ftl, timeout_ms);
+    }
+
+    uint32_t eraseCount = ftl->sectors[physical].eraseCount;
+    uint8_t entry[SERIALFLASHFTL_ENTRY_SIZE] = {
+        (uint8_t)logical, (uint8_t)(logical >> 8), (uint8_t)physical, (uint8_t)(physical >> 8)
+    };
+    SerialFlashFTL_PutU32(entry + 4, eraseCount);
+    SerialFlashFTL_PutU32(entry + 8, SerialFlashFTL_EntryCheck(logical, physical, eraseCount));
+
+    if (!SerialFlash_Write(ftl->platform, ftl->journalAddress, entry, sizeof(entry), timeout_ms)) {
+        return false;
+    }
+
+    ftl->journalAddress += SERIALFLASHFTL_ENTRY_SIZE;
+    return true;
+}
+
+static void SerialFlashFTL_Remap(struct SerialFlashFTL *ftl, uint16_t logical, uint16_t physical) {
+    uint16_t old = ftl->map[logical];
+    if (old != SERIALFLASHFTL_UNMAPPED) {
+        ftl->sectors[old].logical = SERIALFLASHFTL_UNMAPPED;
+    }
+
+    ftl->map[logical] = physical;
+    ftl->sectors[physical].logical = logical;
+}
+
+static void SerialFlashFTL_RebuildOwners(struct SerialFlashFTL *ftl) {
+    for (uint32_t i = 0; i < ftl->sectorCount; i++) {
+        ftl->sectors[i].logical = SERIALFLASHFTL_UNMAPPED;
+    }
+
+    for (uint32_t i = 0; i < ftl->blockCount; i++) {
+        if (ftl->map[i] < ftl->sectorCount) {
+            ftl->sectors[ftl->map[i]].logical = (uint16_t)i;
+        } else {
+            ftl->map[i] = SERIALFLASHFTL_UNMAPPED;
+        }
+    }
+}
+
+bool SerialFlashFTL_Format(struct SerialFlashFTL *ftl, const struct SerialFlash_Platform *platform,
+    uint16_t *map, struct SerialFlashFTL_Sector *sectors, uint32_t arraySize, uint32_t spareSectors,
+    uint32_t staticThreshold, uint32_t timeout_ms) {
+    if (!SerialFlashFTL_Start(ftl, platform, map, sectors, arraySize, spareSectors, staticThreshold)) {
+        return false;
+    }
+
+    // Data sectors are erased when they are allocated
+    for (uint32_t i = 0; i < ftl->blockCount; i++) {
+        ftl->map[i] = SERIALFLASHFTL_UNMAPPED;
+    }
+    for (uint32_t i = 0; i < ftl->sectorCount; i++) {
+        ftl->sectors[i].eraseCount = 0;
+        ftl->sectors[i].logical = SERIALFLASHFTL_UNMAPPED;
+    }
+
+    // Invalidate both areas, the checkpoint goes to area 0
+    ftl->area = 1;
+    return SerialFlash_Erase(platform, SerialFlashFTL_AreaAddress(ftl, 1), ftl->areaSectors * SERIALFLASH_SECTOR_SIZE, timeout_ms) &&
+        SerialFlashFTL_Checkpoint(ftl, timeout_ms);
+}
+
+bool SerialFlashFTL_Mount(struct SerialFlashFTL *ftl, const struct SerialFlash_Platform *platform,
+    uint16_t *map, struct SerialFlashFTL_Sector *sectors, uint32_t arraySize, uint32_t spareSectors,
+    uint32_t staticThreshold, uint32_t timeout_ms) {
+    if (!SerialFlashFTL_Start(ftl, platform, map, sectors, arraySize, spareSectors, staticThreshold)) {
+        return false;
+    }
+
+    // Newest valid checkpoint of the same geometry
+    bool found = false;
+    for (uint32_t area = 0; area < 2; area++) {
+        uint8_t header[SERIALFLASHFTL_HEADER_SIZE];
+        if (!SerialFlash_Read(platform, SerialFlashFTL_AreaAddress(ftl, area), header, sizeof(header), timeout_ms)) {
+            return false;
+        }
+
+        uint32_t seq = (uint32_t)BITOPS_READ_U32L(header + 4);
+        if ((uint32_t)BITOPS_READ_U32L(header) == SERIALFLASHFTL_MAGIC &&
+            (uint32_t)BITOPS_READ_U32L(header + 8) == ftl->blockCount &&
+            (uint32_t)BITOPS_READ_U32L(header + 12) == ftl->sectorCount &&
+            (!found || (int32_t)(seq - ftl->seq) > 0)) {
+            found = true;
+            ftl->area = area;
+            ftl->seq = seq;
+        }
+    }
+
+    if (!found) {
+        return SerialFlashFTL_Format(ftl, platform, map, sectors, arraySize, spareSectors, staticThreshold, timeout_ms);
+    }
+
+    uint32_t address = SerialFlashFTL_AreaAddress(ftl, ftl->area);
+    if (!SerialFlashFTL_ReadTable(ftl, address + SERIALFLASHFTL_HEADER_SIZE, false, timeout_ms) ||
+        !SerialFlashFTL_ReadTable(ftl, address + SERIALFLASHFTL_HEADER_SIZE + ftl->blockCount * 2, true, timeout_ms)) {
+        return false;
+    }
+    SerialFlashFTL_RebuildOwners(ftl);
+
+    // Replay the journal
+    ftl->journalAddress = SerialFlashFTL_JournalStart(ftl, ftl->area);
+    ftl->journalEnd = address + ftl->areaSectors * SERIALFLASH_SECTOR_SIZE;
+    bool torn = false;
+
+    while (ftl->journalAddress + SERIALFLASHFTL_ENTRY_SIZE <= ftl->journalEnd) {
+        uint8_t entry[SERIALFLASHFTL_ENTRY_SIZE];
+        if (!SerialFlash_Read(platform, ftl->journalAddress, entry, sizeof(entry), timeout_ms)) {
+            return false;
+        }
+
+        uint16_t logical = (uint16_t)BITOPS_READ_U16L(entry);
+        uint16_t physical = (uint16_t)BITOPS_READ_U16L(entry + 2);
+        uint32_t eraseCount = (uint32_t)BITOPS_READ_U32L(entry + 4);
+        uint32_t check = (uint32_t)BITOPS_READ_U32L(entry + 8);
+
+        if (check != SerialFlashFTL_EntryCheck(logical, physical, eraseCount) ||
+            logical >= ftl->blockCount || physical >= ftl->sectorCount) {
+            // Blank is the end, anything else is an interrupted entry
+            for (uint32_t i = 0; i < sizeof(entry); i++) {
+                torn |= entry[i] != UINT8_MAX;
+            }
+            break;
+        }
+
+        ftl->sectors[physical].eraseCount = eraseCount;
+        SerialFlashFTL_Remap(ftl, logical, physical);
+        ftl->journalAddress += SERIALFLASHFTL_ENTRY_SIZE;
+    }
+
+    // Don't append after a torn entry
+    return !torn || SerialFlashFTL_Checkpoint(ftl, timeout_ms);
+}
+
+bool SerialFlashFTL_Read(const struct SerialFlashFTL *ftl, uint32_t block, uint8_t *buffer, uint32_t timeout_ms) {
+    if (block >= ftl->blockCount) {
+        return false;
+    }
+
+    uint16_t physical = ftl->map[block];
+    if (physical == SERIALFLASHFTL_UNMAPPED) {
+        memset(buffer, 0xFF, SERIALFLASH_SECTOR_SIZE);
+        return true;
+    }
+
+    return SerialFlash_Read(ftl->platform, SerialFlashFTL_SectorAddress(ftl, physical), buffer, SERIALFLASH_SECTOR_SIZE, timeout_ms);
+}
+
+// Free sector with the lowest (or highest) erase count
+static uint32_t SerialFlashFTL_FindFree(const struct SerialFlashFTL *ftl, bool worn) {
+    uint32_t best = SERIALFLASHFTL_UNMAPPED;
+
+    for (uint32_t i = 0; i < ftl->sectorCount; i++) {
+        if (ftl->sectors[i].logical != SERIALFLASHFTL_UNMAPPED) {
+            continue;
+        }
+
+        if (best == SERIALFLASHFTL_UNMAPPED ||
+            (worn ? ftl->sectors[i].eraseCount > ftl->sectors[best].eraseCount : ftl->sectors[i].eraseCount < ftl->sectors[best].eraseCount)) {
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+static bool SerialFlashFTL_EraseSector(struct SerialFlashFTL *ftl, uint32_t sector, uint32_t timeout_ms) {
+    ftl->sectors[sector].eraseCount++;
+    return SerialFlash_Erase(ftl->platform, SerialFlashFTL_SectorAddress(ftl, sector), SERIALFLASH_SECTOR_SIZE, timeout_ms);
+}
+
+// Moves the coldest block onto the most worn free sector, once per write at most
+static bool SerialFlashFTL_StaticLevel(struct SerialFlashFTL *ftl, uint32_t timeout_ms) {
+    if (!ftl->staticThreshold) {
+        return true;
+    }
+
+    uint32_t cold = SERIALFLASHFTL_UNMAPPED;
+    for (uint32_t i = 0; i < ftl->sectorCount; i++) {
+        if (ftl->sectors[i].logical != SERIALFLASHFTL_UNMAPPED &&
+            (cold == SERIALFLASHFTL_UNMAPPED || ftl->sectors[i].eraseCount < ftl->sectors[cold].eraseCount)) {
+            cold = i;
+        }
+    }
+
+    uint32_t worn = SerialFlashFTL_FindFree(ftl, true);
+    if (cold == SERIALFLASHFTL_UNMAPPED || worn == SERIALFLASHFTL_UNMAPPED ||
+        ftl->sectors[worn].eraseCount - ftl->sectors[cold].eraseCount <= ftl->staticThreshold ||
+        ftl->sectors[worn].eraseCount < ftl->sectors[cold].eraseCount) {
+        return true;
+    }
+
+    if (!SerialFlashFTL_EraseSector(ftl, worn, timeout_ms)) {
+        return false;
+    }
+
+    uint8_t page[SERIALFLASH_PAGE_SIZE];
+    for (uint32_t offset = 0; offset < SERIALFLASH_SECTOR_SIZE; offset += sizeof(page)) {
+        if (!SerialFlash_Read(ftl->platform, SerialFlashFTL_SectorAddress(ftl, cold) + offset, page, sizeof(page), timeout_ms) ||
+            !SerialFlash_Write(ftl->platform, SerialFlashFTL_SectorAddress(ftl, worn) + offset, page, sizeof(page), timeout_ms)) {
+            return false;
+        }
+    }
+
+    uint16_t logical = ftl->sectors[cold].logical;
+    SerialFlashFTL_Remap(ftl, logical, (uint16_t)worn);
+    ftl->moves++;
+
+    return SerialFlashFTL_Journal(ftl, logical, (uint16_t)worn, timeout_ms);
+}
+
+bool SerialFlashFTL_Write(struct SerialFlashFTL *ftl, uint32_t block, const uint8_t *buffer, uint32_t timeout_ms) {
+    if (block >= ftl->blockCount) {
+        return false;
+    }
+
+    // The old copy stays valid until the journal entry is written
+    uint32_t physical = SerialFlashFTL_FindFree(ftl, false);
+    if (physical == SERIALFLASHFTL_UNMAPPED) {
+        return false;
+    }
+
+    if (!SerialFlashFTL_EraseSector(ftl, physical, timeout_ms) ||
+        !SerialFlash_Write(ftl->platform, SerialFlashFTL_SectorAddress(ftl, physical), buffer, SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+        return false;
+    }
+
+    SerialFlashFTL_Remap(ftl, (uint16_t)block, (uint16_t)physical);
+    ftl->writes++;
+
+    if (!SerialFlashFTL_Journal(ftl, (uint16_t)block, (uint16_t)physical, timeout_ms)) {
+        return false;
+    }
+
+    return SerialFlashFTL_StaticLevel(ftl, timeout_ms);
+}
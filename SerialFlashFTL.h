@@ -0,0 +1,64 @@
+#ifndef SERIALFLASHFTL_H
+#define SERIALFLASHFTL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Wear-leveling flash translation layer: a block device of SERIALFLASH_SECTOR_SIZE blocks
+// over the whole chip. Every block write goes to the free physical sector with the lowest
+// erase count (dynamic leveling), and cold blocks are moved onto worn free sectors when the
+// erase count spread exceeds a threshold (static leveling).
+// The mapping and erase counts live in RAM (caller-supplied) and on flash as a checkpoint
+// followed by a journal of remaps, in two ping-pong areas at the start of the chip.
+
+#define SERIALFLASHFTL_MAGIC 0x4C544653 // "SFTL"
+#define SERIALFLASHFTL_UNMAPPED UINT16_MAX
+
+// Upper bound of the map and sector array lengths for a chip
+#define SERIALFLASHFTL_ARRAY_SIZE(capacity) ((capacity) / SERIALFLASH_SECTOR_SIZE)
+
+struct SerialFlashFTL_Sector {
+    uint32_t eraseCount;
+    uint16_t logical; // Block stored here, SERIALFLASHFTL_UNMAPPED if free
+};
+
+struct SerialFlashFTL {
+    const struct SerialFlash_Platform *platform;
+
+    uint16_t *map; // Logical block to physical sector
+    struct SerialFlashFTL_Sector *sectors;
+    uint32_t blockCount; // Logical blocks
+    uint32_t sectorCount; // Physical data sectors
+    uint32_t dataBase; // Address of physical sector 0
+    uint32_t areaSectors; // Per metadata area
+
+    uint32_t staticThreshold; // Erase count spread that triggers a move, 0 disables static leveling
+
+    uint32_t area; // Active metadata area
+    uint32_t seq; // Checkpoint sequence
+    uint32_t journalAddress; // Next journal entry
+    uint32_t journalEnd;
+
+    uint32_t writes; // Block writes
+    uint32_t moves; // Static leveling moves
+    uint32_t checkpoints;
+};
+
+// Sizes the device from SerialFlash_ReadCapacity(), spareSectors (at least 1) are kept free for leveling
+bool SerialFlashFTL_Format(struct SerialFlashFTL *ftl, const struct SerialFlash_Platform *platform,
+    uint16_t *map, struct SerialFlashFTL_Sector *sectors, uint32_t arraySize, uint32_t spareSectors,
+    uint32_t staticThreshold, uint32_t timeout_ms);
+// Loads the newest checkpoint and replays its journal, formats the chip if there is none
+bool SerialFlashFTL_Mount(struct SerialFlashFTL *ftl, const struct SerialFlash_Platform *platform,
+    uint16_t *map, struct SerialFlashFTL_Sector *sectors, uint32_t arraySize, uint32_t spareSectors,
+    uint32_t staticThreshold, uint32_t timeout_ms);
+
+// Whole blocks of SERIALFLASH_SECTOR_SIZE, never written blocks read as 0xFF
+bool SerialFlashFTL_Read(const struct SerialFlashFTL *ftl, uint32_t block, uint8_t *buffer, uint32_t timeout_ms);
+bool SerialFlashFTL_Write(struct SerialFlashFTL *ftl, uint32_t block, const uint8_t *buffer, uint32_t timeout_ms);
+
+// Writes a fresh checkpoint, shortening the journal replay at the next mount
+bool SerialFlashFTL_Checkpoint(struct SerialFlashFTL *ftl, uint32_t timeout_ms);
+
+#endif // SERIALFLASHFTL_H
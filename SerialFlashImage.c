@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "SerialFlashImage.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SerialFlashSim.h"
+
+bool SerialFlashImage_Open(struct SerialFlashImage *image, const char *path, uint32_t capacity) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size > UINT32_MAX) {
+        close(fd);
+        return false;
+    }
+
+    uint32_t size = (uint32_t)st.st_size;
+    if (capacity == 0) {
+        capacity = size;
+    }
+    if (size > capacity || capacity < SERIALFLASH_BLOCK_SIZE || (capacity & (capacity - 1)) != 0 ||
+        (size < capacity && ftruncate(fd, (off_t)capacity) != 0)) {
+        close(fd);
+        return false;
+    }
+
+    void *memory = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    // The extension reads as zeros, make it erased flash
+    memset((uint8_t *)memory + size, 0xFF, capacity - size);
+
+    // No bus or busy time, polls see the chip ready at once
+    struct SerialFlashSim_Config config;
+    SerialFlashSim_DefaultConfig(&config, memory, capacity);
+    config.clockHz = UINT32_MAX;
+    config.transactionNs = 0;
+    config.pageProgramUs = 0;
+    config.sectorEraseUs = 0;
+    config.block32kEraseUs = 0;
+    config.block64kEraseUs = 0;
+    config.chipEraseUs = 0;
+    config.writeStatusUs = 0;
+    if (!SerialFlashSim_Init(&config)) {
+        munmap(memory, capacity);
+        close(fd);
+        return false;
+    }
+
+    image->platform = SerialFlashSim_TransferPlatform;
+    image->platform.state = NULL;
+    image->memory = memory;
+    image->capacity = capacity;
+    image->fd = fd;
+
+    return true;
+}
+
+bool SerialFlashImage_Sync(const struct SerialFlashImage *image) {
+    return msync(image->memory, image->capacity, MS_SYNC) == 0;
+}
+
+bool SerialFlashImage_Close(struct SerialFlashImage *image) {
+    bool ok = SerialFlashImage_Sync(image);
+    ok &= munmap(image->memory, image->capacity) == 0;
+    ok &= close(image->fd) == 0;
+
+    image->memory = NULL;
+    image->capacity = 0;
+    image->fd = -1;
+
+    return ok;
+}
+
+const uint8_t *SerialFlashImage_GetPointer(const struct SerialFlashImage *image, uint32_t address, uint32_t length) {
+    if (address > image->capacity || length > image->capacity - address) {
+        return NULL;
+    }
+
+    return image->memory + address;
+}
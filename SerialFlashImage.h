@@ -0,0 +1,32 @@
+#ifndef SERIALFLASHIMAGE_H
+#define SERIALFLASHIMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Flash image file as a chip, for host tools (POSIX). The file is mmap'ed as the memory of the
+// simulator with all timings at zero, so images are built and patched through the regular API
+// (SerialFlash_Write(), SerialFlash_Erase(), ...) at memory speed: programs AND into the mapping
+// in place, erases fill it with 0xFF. The simulator is a singleton, one image (or simulation) at a time.
+
+struct SerialFlashImage {
+    struct SerialFlash_Platform platform; // Pass &image->platform to the driver, a state may be attached
+    uint8_t *memory; // The mapping
+    uint32_t capacity;
+    int fd;
+};
+
+// Maps the file, creating it or extending it to capacity with 0xFF bytes. Capacity 0 takes the file size.
+// The capacity must be a power of two of at least SERIALFLASH_BLOCK_SIZE, a larger file is refused.
+bool SerialFlashImage_Open(struct SerialFlashImage *image, const char *path, uint32_t capacity);
+// Writes the changes back to the file
+bool SerialFlashImage_Sync(const struct SerialFlashImage *image);
+// Syncs and unmaps
+bool SerialFlashImage_Close(struct SerialFlashImage *image);
+
+// Zero-copy read: the bytes in the mapping, NULL if the range is outside the image.
+// Valid until close, later programs and erases show through.
+const uint8_t *SerialFlashImage_GetPointer(const struct SerialFlashImage *image, uint32_t address, uint32_t length);
+
+#endif // SERIALFLASHIMAGE_H
@@ -0,0 +1,467 @@
+#include "SerialFlashKV.h"
+
+#include <string.h>
+#include "BitOps.h"
+
+#define SERIALFLASHKV_TOMBSTONE 0x8000 // Length flag of a delete record
+#define SERIALFLASHKV_COMMITTED 0x00 // Commit byte, programmed after the value
+
+#define SERIALFLASHKV_COPY_CHUNK 64 // Stack buffer for moving values
+
+struct SerialFlashKV_Record {
+    uint32_t key;
+    uint16_t length; // With SERIALFLASHKV_TOMBSTONE
+    bool committed;
+};
+
+static uint32_t SerialFlashKV_SectorAddress(const struct SerialFlashKV *kv, uint32_t sector) {
+    return kv->base + sector * SERIALFLASH_SECTOR_SIZE;
+}
+
+static uint8_t SerialFlashKV_Check(uint16_t length) {
+    return (uint8_t)~(length ^ (length >> 8));
+}
+
+// Index
+
+static uint32_t SerialFlashKV_Slot(const struct SerialFlashKV *kv, uint32_t key) {
+    // Fibonacci hashing, the top bits are the best mixed
+    return (uint32_t)(key * 2654435761u) >> kv->indexShift;
+}
+
+static struct SerialFlashKV_Entry *SerialFlashKV_Find(const struct SerialFlashKV *kv, uint32_t key) {
+    for (uint32_t i = SerialFlashKV_Slot(kv, key);; i = (i + 1) & (kv->indexSize - 1)) {
+        struct SerialFlashKV_Entry *entry = &kv->index[i];
+
+        if (entry->key == key) {
+            return entry;
+        }
+        if (entry->key == SERIALFLASHKV_KEY_EMPTY) {
+            return NULL;
+        }
+    }
+}
+
+static bool SerialFlashKV_Insert(struct SerialFlashKV *kv, uint32_t key, uint32_t address, uint16_t length) {
+    uint32_t i = SerialFlashKV_Slot(kv, key);
+    while (kv->index[i].key != key && kv->index[i].key != SERIALFLASHKV_KEY_EMPTY) {
+        i = (i + 1) & (kv->indexSize - 1);
+    }
+
+    if (kv->index[i].key == SERIALFLASHKV_KEY_EMPTY) {
+        // Keep a free slot so probing always terminates
+        if (kv->count + 2 > kv->indexSize) {
+            return false;
+        }
+        kv->count++;
+    }
+
+    kv->index[i].key = key;
+    kv->index[i].address = address;
+    kv->index[i].length = length;
+
+    return true;
+}
+
+static void SerialFlashKV_Remove(struct SerialFlashKV *kv, uint32_t key) {
+    struct SerialFlashKV_Entry *entry = SerialFlashKV_Find(kv, key);
+    if (!entry) {
+        return;
+    }
+
+    // Backward shift deletion, no tombstones in the index
+    uint32_t mask = kv->indexSize - 1;
+    uint32_t hole = (uint32_t)(entry - kv->index);
+    for (uint32_t i = (hole + 1) & mask; kv->index[i].key != SERIALFLASHKV_KEY_EMPTY; i = (i + 1) & mask) {
+        uint32_t home = SerialFlashKV_Slot(kv, kv->index[i].key);
+
+        // Move the entry if its home is not within (hole, i]
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            kv->index[hole] = kv->index[i];
+            hole = i;
+        }
+    }
+
+    kv->index[hole].key = SERIALFLASHKV_KEY_EMPTY;
+    kv->count--;
+}
+
+static void SerialFlashKV_ClearIndex(struct SerialFlashKV *kv) {
+    for (uint32_t i = 0; i < kv->indexSize; i++) {
+        kv->index[i].key = SERIALFLASHKV_KEY_EMPTY;
+    }
+    kv->count = 0;
+}
+
+// Flash layout
+
+static bool SerialFlashKV_ReadHeader(const struct SerialFlashKV *kv, uint32_t sector, bool *valid, uint32_t *seq, uint32_t timeout_ms) {
+    uint8_t header[SERIALFLASHKV_HEADER_SIZE];
+
+    if (!SerialFlash_Read(kv->platform, SerialFlashKV_SectorAddress(kv, sector), header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    *valid = (uint32_t)BITOPS_READ_U32L(header) == SERIALFLASHKV_MAGIC;
+    *seq = (uint32_t)BITOPS_READ_U32L(header + 4);
+
+    return true;
+}
+
+static bool SerialFlashKV_WriteHeader(struct SerialFlashKV *kv, uint32_t sector, uint32_t seq, uint32_t timeout_ms) {
+    uint8_t header[SERIALFLASHKV_HEADER_SIZE] = {
+        (uint8_t)SERIALFLASHKV_MAGIC, (uint8_t)(SERIALFLASHKV_MAGIC >> 8), (uint8_t)(SERIALFLASHKV_MAGIC >> 16), (uint8_t)(SERIALFLASHKV_MAGIC >> 24),
+        (uint8_t)seq, (uint8_t)(seq >> 8), (uint8_t)(seq >> 16), (uint8_t)(seq >> 24)
+    };
+
+    if (!SerialFlash_Write(kv->platform, SerialFlashKV_SectorAddress(kv, sector), header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    kv->head = sector;
+    kv->headSeq = seq;
+    kv->writeOffset = SERIALFLASHKV_HEADER_SIZE;
+
+    return true;
+}
+
+// end is set at a blank header, a torn one or the sector end, blank tells which
+static bool SerialFlashKV_ReadRecord(const struct SerialFlashKV *kv, uint32_t sector, uint32_t offset,
+    struct SerialFlashKV_Record *record, bool *end, bool *blank, uint32_t timeout_ms) {
+    uint8_t header[SERIALFLASHKV_RECORD_HEADER_SIZE];
+
+    *end = true;
+    *blank = false;
+    if (offset + SERIALFLASHKV_RECORD_HEADER_SIZE > SERIALFLASH_SECTOR_SIZE) {
+        return true;
+    }
+
+    if (!SerialFlash_Read(kv->platform, SerialFlashKV_SectorAddress(kv, sector) + offset, header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    record->key = (uint32_t)BITOPS_READ_U32L(header);
+    record->length = (uint16_t)BITOPS_READ_U16L(header + 4);
+    record->committed = header[7] == SERIALFLASHKV_COMMITTED;
+
+    uint32_t valueLength = record->length & ~SERIALFLASHKV_TOMBSTONE;
+    if (record->key == SERIALFLASHKV_KEY_EMPTY) {
+        *blank = record->length == UINT16_MAX && header[6] == UINT8_MAX && header[7] == UINT8_MAX;
+        return true;
+    }
+    if (header[6] != SerialFlashKV_Check(record->length) ||
+        offset + SERIALFLASHKV_RECORD_HEADER_SIZE + valueLength > SERIALFLASH_SECTOR_SIZE) {
+        return true;
+    }
+
+    *end = false;
+    return true;
+}
+
+static bool SerialFlashKV_OpenSector(struct SerialFlashKV *kv, uint32_t timeout_ms) {
+    if (kv->freeSectors == 0) {
+        return false;
+    }
+
+    // A torn erase can leave a blank header over programmed data
+    uint32_t sector = (kv->head + 1) % kv->sectorCount;
+    uint32_t address = SerialFlashKV_SectorAddress(kv, sector);
+    if (!SerialFlash_IsBlank(kv->platform, address, SERIALFLASH_SECTOR_SIZE, timeout_ms) &&
+        !SerialFlash_Erase(kv->platform, address, SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+        return false;
+    }
+
+    if (!SerialFlashKV_WriteHeader(kv, sector, kv->headSeq + 1, timeout_ms)) {
+        return false;
+    }
+
+    kv->freeSectors--;
+    return true;
+}
+
+// Room for need bytes in the head sector, collecting garbage before the reserve sector is taken
+static bool SerialFlashKV_Room(struct SerialFlashKV *kv, uint32_t need, bool collect, uint32_t timeout_ms) {
+    if (kv->writeOffset + need <= SERIALFLASH_SECTOR_SIZE) {
+        return true;
+    }
+
+    if (collect) {
+        for (uint32_t i = 0; i < kv->sectorCount && kv->freeSectors <= 1; i++) {
+            if (!SerialFlashKV_Collect(kv, timeout_ms)) {
+                return false;
+            }
+        }
+
+        // Moving live records may have opened a sector already
+        if (kv->writeOffset + need <= SERIALFLASH_SECTOR_SIZE) {
+            return true;
+        }
+        if (kv->freeSectors <= 1) {
+            return false;
+        }
+    }
+
+    return SerialFlashKV_OpenSector(kv, timeout_ms);
+}
+
+// Appends a record with the value from RAM, or moved from sourceAddress if value is NULL
+static bool SerialFlashKV_WriteRecord(struct SerialFlashKV *kv, uint32_t key, uint16_t length,
+    const uint8_t *value, uint32_t sourceAddress, uint32_t *valueAddress, uint32_t timeout_ms) {
+    uint32_t address = SerialFlashKV_SectorAddress(kv, kv->head) + kv->writeOffset;
+    uint32_t valueLength = length & ~SERIALFLASHKV_TOMBSTONE;
+    uint8_t header[SERIALFLASHKV_RECORD_HEADER_SIZE] = {
+        (uint8_t)key, (uint8_t)(key >> 8), (uint8_t)(key >> 16), (uint8_t)(key >> 24),
+        (uint8_t)length, (uint8_t)(length >> 8), SerialFlashKV_Check(length), UINT8_MAX
+    };
+
+    // Whatever happens next, this space is used
+    kv->writeOffset += SERIALFLASHKV_RECORD_HEADER_SIZE + valueLength;
+    *valueAddress = address + SERIALFLASHKV_RECORD_HEADER_SIZE;
+
+    if (!SerialFlash_Write(kv->platform, address, header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    if (value) {
+        if (!SerialFlash_Write(kv->platform, *valueAddress, value, valueLength, timeout_ms)) {
+            return false;
+        }
+    } else {
+        uint8_t chunk[SERIALFLASHKV_COPY_CHUNK];
+
+        for (uint32_t done = 0; done < valueLength; done += sizeof(chunk)) {
+            uint32_t n = valueLength - done < sizeof(chunk) ? valueLength - done : sizeof(chunk);
+
+            if (!SerialFlash_Read(kv->platform, sourceAddress + done, chunk, n, timeout_ms) ||
+                !SerialFlash_Write(kv->platform, *valueAddress + done, chunk, n, timeout_ms)) {
+                return false;
+            }
+        }
+    }
+
+    // The record counts only once the value is complete
+    uint8_t commit = SERIALFLASHKV_COMMITTED;
+    return SerialFlash_Write(kv->platform, address + SERIALFLASHKV_RECORD_HEADER_SIZE - 1, &commit, 1, timeout_ms);
+}
+
+static bool SerialFlashKV_Start(struct SerialFlashKV *kv, const struct SerialFlash_Platform *platform, uint32_t base, uint32_t sectorCount,
+    struct SerialFlashKV_Entry *index, uint32_t indexSize) {
+    if (sectorCount < 3 || base % SERIALFLASH_SECTOR_SIZE || indexSize < 2 || (indexSize & (indexSize - 1))) {
+        return false;
+    }
+
+    kv->platform = platform;
+    kv->base = base;
+    kv->sectorCount = sectorCount;
+    kv->index = index;
+    kv->indexSize = indexSize;
+    kv->indexShift = 32;
+    for (uint32_t size = indexSize; size > 1; size >>= 1) {
+        kv->indexShift--;
+    }
+    SerialFlashKV_ClearIndex(kv);
+
+    return true;
+}
+
+bool SerialFlashKV_Format(struct SerialFlashKV *kv, const struct SerialFlash_Platform *platform, uint32_t base, uint32_t sectorCount,
+    struct SerialFlashKV_Entry *index, uint32_t indexSize, uint32_t timeout_ms) {
+    if (!SerialFlashKV_Start(kv, platform, base, sectorCount, index, indexSize)) {
+        return false;
+    }
+
+    if (!SerialFlash_Erase(platform, base, sectorCount * SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+        return false;
+    }
+
+    kv->tail = 0;
+    kv->freeSectors = sectorCount - 1;
+
+    return SerialFlashKV_WriteHeader(kv, 0, 1, timeout_ms);
+}
+
+bool SerialFlashKV_Mount(struct SerialFlashKV *kv, const struct SerialFlash_Platform *platform, uint32_t base, uint32_t sectorCount,
+    struct SerialFlashKV_Entry *index, uint32_t indexSize, uint32_t timeout_ms) {
+    if (!SerialFlashKV_Start(kv, platform, base, sectorCount, index, indexSize)) {
+        return false;
+    }
+
+    // Newest sector
+    bool found = false;
+    uint32_t headSeq = 0;
+    for (uint32_t sector = 0; sector < sectorCount; sector++) {
+        bool valid;
+        uint32_t seq;
+        if (!SerialFlashKV_ReadHeader(kv, sector, &valid, &seq, timeout_ms)) {
+            return false;
+        }
+
+        if (valid && (!found || (int32_t)(seq - headSeq) > 0)) {
+            found = true;
+            kv->head = sector;
+            headSeq = seq;
+        }
+    }
+
+    if (!found) {
+        return SerialFlashKV_Format(kv, platform, base, sectorCount, index, indexSize, timeout_ms);
+    }
+
+    // Used sectors run back from the head with consecutive seq
+    uint32_t used = 1;
+    uint32_t tailSeq = headSeq;
+    kv->tail = kv->head;
+    while (used < sectorCount) {
+        uint32_t prev = (kv->tail + sectorCount - 1) % sectorCount;
+        bool valid;
+        uint32_t seq;
+        if (!SerialFlashKV_ReadHeader(kv, prev, &valid, &seq, timeout_ms)) {
+            return false;
+        }
+
+        if (!valid || seq != tailSeq - 1) {
+            break;
+        }
+
+        kv->tail = prev;
+        tailSeq = seq;
+        used++;
+    }
+    kv->freeSectors = sectorCount - used;
+
+    // Replay from the oldest record, later ones win
+    for (uint32_t i = 0, sector = kv->tail; i < used; i++, sector = (sector + 1) % sectorCount) {
+        uint32_t offset = SERIALFLASHKV_HEADER_SIZE;
+        struct SerialFlashKV_Record record;
+        bool end, blank;
+
+        for (;;) {
+            if (!SerialFlashKV_ReadRecord(kv, sector, offset, &record, &end, &blank, timeout_ms)) {
+                return false;
+            }
+
+            if (end) {
+                break;
+            }
+
+            uint32_t valueAddress = SerialFlashKV_SectorAddress(kv, sector) + offset + SERIALFLASHKV_RECORD_HEADER_SIZE;
+            if (!record.committed) {
+                // Interrupted write, skipped
+            } else if (record.length & SERIALFLASHKV_TOMBSTONE) {
+                SerialFlashKV_Remove(kv, record.key);
+            } else if (!SerialFlashKV_Insert(kv, record.key, valueAddress, record.length)) {
+                return false;
+            }
+
+            offset += SERIALFLASHKV_RECORD_HEADER_SIZE + (record.length & ~SERIALFLASHKV_TOMBSTONE);
+        }
+
+        if (sector == kv->head) {
+            kv->headSeq = headSeq;
+            // Don't program over a torn header
+            kv->writeOffset = blank ? offset : SERIALFLASH_SECTOR_SIZE;
+        }
+    }
+
+    return true;
+}
+
+bool SerialFlashKV_Get(const struct SerialFlashKV *kv, uint32_t key, uint8_t *value, uint32_t size, uint32_t *length, uint32_t timeout_ms) {
+    if (key == SERIALFLASHKV_KEY_EMPTY) {
+        return false;
+    }
+
+    const struct SerialFlashKV_Entry *entry = SerialFlashKV_Find(kv, key);
+    if (!entry) {
+        return false;
+    }
+
+    *length = entry->length;
+    return SerialFlash_Read(kv->platform, entry->address, value, entry->length < size ? entry->length : size, timeout_ms);
+}
+
+bool SerialFlashKV_Set(struct SerialFlashKV *kv, uint32_t key, const uint8_t *value, uint32_t length, uint32_t timeout_ms) {
+    if (key == SERIALFLASHKV_KEY_EMPTY || length > SERIALFLASHKV_VALUE_SIZE_MAX) {
+        return false;
+    }
+
+    // Fail before writing anything if a new key doesn't fit the index
+    if (!SerialFlashKV_Find(kv, key) && kv->count + 2 > kv->indexSize) {
+        return false;
+    }
+
+    if (!SerialFlashKV_Room(kv, SERIALFLASHKV_RECORD_HEADER_SIZE + length, true, timeout_ms)) {
+        return false;
+    }
+
+    uint32_t address;
+    if (!SerialFlashKV_WriteRecord(kv, key, (uint16_t)length, value, 0, &address, timeout_ms)) {
+        return false;
+    }
+
+    return SerialFlashKV_Insert(kv, key, address, (uint16_t)length);
+}
+
+bool SerialFlashKV_Delete(struct SerialFlashKV *kv, uint32_t key, uint32_t timeout_ms) {
+    if (key == SERIALFLASHKV_KEY_EMPTY || !SerialFlashKV_Find(kv, key)) {
+        return true;
+    }
+
+    if (!SerialFlashKV_Room(kv, SERIALFLASHKV_RECORD_HEADER_SIZE, true, timeout_ms)) {
+        return false;
+    }
+
+    uint32_t address;
+    if (!SerialFlashKV_WriteRecord(kv, key, SERIALFLASHKV_TOMBSTONE, NULL, 0, &address, timeout_ms)) {
+        return false;
+    }
+
+    SerialFlashKV_Remove(kv, key);
+    return true;
+}
+
+bool SerialFlashKV_Collect(struct SerialFlashKV *kv, uint32_t timeout_ms) {
+    if (kv->tail == kv->head) {
+        return true;
+    }
+
+    // Move the records the index still points to
+    uint32_t sector = kv->tail;
+    uint32_t offset = SERIALFLASHKV_HEADER_SIZE;
+    for (;;) {
+        struct SerialFlashKV_Record record;
+        bool end, blank;
+        if (!SerialFlashKV_ReadRecord(kv, sector, offset, &record, &end, &blank, timeout_ms)) {
+            return false;
+        }
+
+        if (end) {
+            break;
+        }
+
+        uint32_t valueAddress = SerialFlashKV_SectorAddress(kv, sector) + offset + SERIALFLASHKV_RECORD_HEADER_SIZE;
+        uint32_t valueLength = record.length & ~SERIALFLASHKV_TOMBSTONE;
+        struct SerialFlashKV_Entry *entry = SerialFlashKV_Find(kv, record.key);
+
+        if (entry && entry->address == valueAddress) {
+            uint32_t address;
+            if (!SerialFlashKV_Room(kv, SERIALFLASHKV_RECORD_HEADER_SIZE + valueLength, false, timeout_ms) ||
+                !SerialFlashKV_WriteRecord(kv, record.key, record.length, NULL, valueAddress, &address, timeout_ms)) {
+                return false;
+            }
+            entry->address = address;
+        }
+
+        offset += SERIALFLASHKV_RECORD_HEADER_SIZE + valueLength;
+    }
+
+    // Tombstones go too, there is nothing older left for them to hide
+    if (!SerialFlash_Erase(kv->platform, SerialFlashKV_SectorAddress(kv, sector), SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+        return false;
+    }
+
+    kv->tail = (kv->tail + 1) % kv->sectorCount;
+    kv->freeSectors++;
+
+    return true;
+}
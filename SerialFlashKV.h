@@ -0,0 +1,60 @@
+#ifndef SERIALFLASHKV_H
+#define SERIALFLASHKV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Log-structured key-value store with numeric keys over a range of sectors.
+// Records {u32 key, u16 length, u8 check, u8 commit, value} are appended to sectors
+// {magic, seq} used in circular order. A RAM open-addressing index (caller-supplied)
+// maps keys to value addresses, so a lookup is a single read. It is rebuilt at mount.
+// Garbage collection moves the live records of the oldest sector and erases it,
+// one sector per call, and runs by itself when only the reserve sector is left.
+
+#define SERIALFLASHKV_MAGIC 0x564B4653 // "SFKV"
+#define SERIALFLASHKV_HEADER_SIZE 8
+#define SERIALFLASHKV_RECORD_HEADER_SIZE 8
+#define SERIALFLASHKV_VALUE_SIZE_MAX (SERIALFLASH_SECTOR_SIZE - SERIALFLASHKV_HEADER_SIZE - SERIALFLASHKV_RECORD_HEADER_SIZE)
+
+#define SERIALFLASHKV_KEY_EMPTY UINT32_MAX // Reserved
+
+struct SerialFlashKV_Entry {
+    uint32_t key; // SERIALFLASHKV_KEY_EMPTY for a free slot
+    uint32_t address; // Value address
+    uint16_t length;
+};
+
+struct SerialFlashKV {
+    const struct SerialFlash_Platform *platform;
+    uint32_t base; // Sector aligned
+    uint32_t sectorCount; // At least 3
+
+    struct SerialFlashKV_Entry *index;
+    uint32_t indexSize; // Power of two, keep it well above the key count
+    uint32_t indexShift; // 32 - log2(indexSize), keeps the top bits of the hash
+    uint32_t count; // Keys in the index
+
+    uint32_t head; // Sector being appended to
+    uint32_t headSeq;
+    uint32_t writeOffset;
+    uint32_t tail; // Oldest sector
+    uint32_t freeSectors; // Erased sectors, one is kept for garbage collection
+};
+
+// Erases the range and starts an empty store
+bool SerialFlashKV_Format(struct SerialFlashKV *kv, const struct SerialFlash_Platform *platform, uint32_t base, uint32_t sectorCount,
+    struct SerialFlashKV_Entry *index, uint32_t indexSize, uint32_t timeout_ms);
+// Replays the records into the index, formats the range if it holds no store
+bool SerialFlashKV_Mount(struct SerialFlashKV *kv, const struct SerialFlash_Platform *platform, uint32_t base, uint32_t sectorCount,
+    struct SerialFlashKV_Entry *index, uint32_t indexSize, uint32_t timeout_ms);
+
+// Returns false if the key is missing. Values longer than size are truncated, length is the full one.
+bool SerialFlashKV_Get(const struct SerialFlashKV *kv, uint32_t key, uint8_t *value, uint32_t size, uint32_t *length, uint32_t timeout_ms);
+bool SerialFlashKV_Set(struct SerialFlashKV *kv, uint32_t key, const uint8_t *value, uint32_t length, uint32_t timeout_ms);
+bool SerialFlashKV_Delete(struct SerialFlashKV *kv, uint32_t key, uint32_t timeout_ms);
+
+// Reclaims the oldest sector, for idle time
+bool SerialFlashKV_Collect(struct SerialFlashKV *kv, uint32_t timeout_ms);
+
+#endif // SERIALFLASHKV_H
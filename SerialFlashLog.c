@@ -0,0 +1,287 @@
+#include "SerialFlashLog.h"
+#include "BitOps.h"
+
+static uint32_t SerialFlashLog_SectorAddress(const struct SerialFlashLog *log, uint32_t sector) {
+    return log->base + sector * SERIALFLASH_SECTOR_SIZE;
+}
+
+// valid is false for a blank (or foreign) sector
+static bool SerialFlashLog_ReadHeader(const struct SerialFlashLog *log, uint32_t sector, bool *valid, uint32_t *seq, uint32_t timeout_ms) {
+    uint8_t header[SERIALFLASHLOG_HEADER_SIZE];
+
+    if (!SerialFlash_Read(log->platform, SerialFlashLog_SectorAddress(log, sector), header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    *valid = (uint32_t)BITOPS_READ_U32L(header) == SERIALFLASHLOG_MAGIC;
+    *seq = (uint32_t)BITOPS_READ_U32L(header + 4);
+
+    return true;
+}
+
+static bool SerialFlashLog_WriteHeader(struct SerialFlashLog *log, uint32_t sector, uint32_t seq, uint32_t timeout_ms) {
+    uint8_t header[SERIALFLASHLOG_HEADER_SIZE] = {
+        (uint8_t)SERIALFLASHLOG_MAGIC, (uint8_t)(SERIALFLASHLOG_MAGIC >> 8), (uint8_t)(SERIALFLASHLOG_MAGIC >> 16), (uint8_t)(SERIALFLASHLOG_MAGIC >> 24),
+        (uint8_t)seq, (uint8_t)(seq >> 8), (uint8_t)(seq >> 16), (uint8_t)(seq >> 24)
+    };
+
+    if (!SerialFlash_Write(log->platform, SerialFlashLog_SectorAddress(log, sector), header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    log->head = sector;
+    log->headSeq = seq;
+    log->writeOffset = SERIALFLASHLOG_HEADER_SIZE;
+
+    return true;
+}
+
+// Reads a record header, valid is false if it is blank, torn or past the sector end
+static bool SerialFlashLog_ReadRecordHeader(const struct SerialFlashLog *log, uint32_t sector, uint32_t offset,
+    bool *valid, uint32_t *length, uint32_t *crc, uint32_t timeout_ms) {
+    uint8_t header[SERIALFLASHLOG_RECORD_HEADER_SIZE];
+
+    *valid = false;
+    if (offset + SERIALFLASHLOG_RECORD_HEADER_SIZE > SERIALFLASH_SECTOR_SIZE) {
+        return true;
+    }
+
+    if (!SerialFlash_Read(log->platform, SerialFlashLog_SectorAddress(log, sector) + offset, header, sizeof(header), timeout_ms)) {
+        return false;
+    }
+
+    uint16_t len = (uint16_t)BITOPS_READ_U16L(header);
+    uint16_t inv = (uint16_t)BITOPS_READ_U16L(header + 2);
+    *valid = (uint16_t)(len ^ inv) == 0xFFFF && offset + SERIALFLASHLOG_RECORD_HEADER_SIZE + len <= SERIALFLASH_SECTOR_SIZE;
+    *length = len;
+    *crc = (uint32_t)BITOPS_READ_U32L(header + 4);
+
+    return true;
+}
+
+static bool SerialFlashLog_Start(struct SerialFlashLog *log, const struct SerialFlash_Platform *platform,
+    uint32_t base, uint32_t sectorCount) {
+    if (sectorCount < 2 || base % SERIALFLASH_SECTOR_SIZE) {
+        return false;
+    }
+
+    log->platform = platform;
+    log->base = base;
+    log->sectorCount = sectorCount;
+    log->tail = 0;
+
+    return true;
+}
+
+bool SerialFlashLog_Format(struct SerialFlashLog *log, const struct SerialFlash_Platform *platform,
+    uint32_t base, uint32_t sectorCount, uint32_t timeout_ms) {
+    if (!SerialFlashLog_Start(log, platform, base, sectorCount)) {
+        return false;
+    }
+
+    if (!SerialFlash_Erase(platform, base, sectorCount * SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+        return false;
+    }
+
+    return SerialFlashLog_WriteHeader(log, 0, 1, timeout_ms);
+}
+
+bool SerialFlashLog_Mount(struct SerialFlashLog *log, const struct SerialFlash_Platform *platform,
+    uint32_t base, uint32_t sectorCount, uint32_t timeout_ms) {
+    if (!SerialFlashLog_Start(log, platform, base, sectorCount)) {
+        return false;
+    }
+
+    bool valid;
+    uint32_t seq, firstSeq;
+    uint32_t head;
+
+    if (!SerialFlashLog_ReadHeader(log, 0, &valid, &firstSeq, timeout_ms)) {
+        return false;
+    }
+
+    if (valid) {
+        // Sectors from 0 up to the head have increasing seq, the erased one and older sectors follow,
+        // so the head is the last sector with seq >= seq(0)
+        uint32_t lo = 0;
+        uint32_t hi = sectorCount - 1;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+
+            if (!SerialFlashLog_ReadHeader(log, mid, &valid, &seq, timeout_ms)) {
+                return false;
+            }
+
+            if (valid && seq - firstSeq < UINT32_MAX / 2) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        head = lo;
+    } else {
+        // Sector 0 is erased ahead only when the last sector is the head
+        head = sectorCount - 1;
+    }
+
+    if (!SerialFlashLog_ReadHeader(log, head, &valid, &seq, timeout_ms)) {
+        return false;
+    }
+
+    if (!valid) {
+        // Blank range
+        if (!SerialFlash_Erase(platform, base, 2 * SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+            return false;
+        }
+
+        return SerialFlashLog_WriteHeader(log, 0, 1, timeout_ms);
+    }
+
+    log->head = head;
+    log->headSeq = seq;
+
+    // Finish an erase ahead interrupted by a reset, a torn one may have cleared the header only
+    uint32_t ahead = (head + 1) % sectorCount;
+    uint32_t aheadAddress = SerialFlashLog_SectorAddress(log, ahead);
+    if (ahead != head && !SerialFlash_IsBlank(platform, aheadAddress, SERIALFLASH_SECTOR_SIZE, timeout_ms) &&
+        !SerialFlash_Erase(platform, aheadAddress, SERIALFLASH_SECTOR_SIZE, timeout_ms)) {
+        return false;
+    }
+
+    // The log has wrapped if there is data after the erased sector
+    uint32_t tail = (head + 2) % sectorCount;
+    uint32_t tailSeq;
+    if (!SerialFlashLog_ReadHeader(log, tail, &valid, &tailSeq, timeout_ms)) {
+        return false;
+    }
+    log->tail = valid ? tail : 0;
+
+    // Find the end of the head sector
+    uint32_t offset = SERIALFLASHLOG_HEADER_SIZE;
+    for (;;) {
+        uint32_t length, crc;
+        if (!SerialFlashLog_ReadRecordHeader(log, head, offset, &valid, &length, &crc, timeout_ms)) {
+            return false;
+        }
+
+        if (!valid) {
+            break;
+        }
+
+        offset += SERIALFLASHLOG_RECORD_HEADER_SIZE + length;
+    }
+
+    // Anything but a blank header is a torn append, don't program over it
+    bool blank = offset + SERIALFLASHLOG_RECORD_HEADER_SIZE <= SERIALFLASH_SECTOR_SIZE &&
+        SerialFlash_IsBlank(platform, SerialFlashLog_SectorAddress(log, head) + offset, SERIALFLASHLOG_RECORD_HEADER_SIZE, timeout_ms);
+    log->writeOffset = blank ? offset : SERIALFLASH_SECTOR_SIZE;
+
+    return true;
+}
+
+static bool SerialFlashLog_NextSector(struct SerialFlashLog *log, uint32_t timeout_ms) {
+    uint32_t next = (log->head + 1) % log->sectorCount;
+
+    // Already erased ahead
+    if (!SerialFlashLog_WriteHeader(log, next, log->headSeq + 1, timeout_ms)) {
+        return false;
+    }
+
+    // Erase ahead, dropping the oldest sector if the log is full
+    uint32_t ahead = (next + 1) % log->sectorCount;
+    if (ahead == log->tail) {
+        log->tail = (ahead + 1) % log->sectorCount;
+    }
+
+    return SerialFlash_Erase(log->platform, SerialFlashLog_SectorAddress(log, ahead), SERIALFLASH_SECTOR_SIZE, timeout_ms);
+}
+
+bool SerialFlashLog_Append(struct SerialFlashLog *log, const uint8_t *data, uint32_t length, uint32_t timeout_ms) {
+    if (length > SERIALFLASHLOG_RECORD_SIZE_MAX) {
+        return false;
+    }
+
+    if (log->writeOffset + SERIALFLASHLOG_RECORD_HEADER_SIZE + length > SERIALFLASH_SECTOR_SIZE &&
+        !SerialFlashLog_NextSector(log, timeout_ms)) {
+        return false;
+    }
+
+    uint32_t address = SerialFlashLog_SectorAddress(log, log->head) + log->writeOffset;
+    uint32_t crc = SerialFlash_Crc32(0, data, length);
+    uint8_t header[SERIALFLASHLOG_RECORD_HEADER_SIZE] = {
+        (uint8_t)length, (uint8_t)(length >> 8), (uint8_t)~length, (uint8_t)(~length >> 8),
+        (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24)
+    };
+
+    // Header and data in one write, the CRC tells a torn one
+    struct SerialFlash_Chunk chunks[2] = { { header, sizeof(header) }, { data, length } };
+    if (!SerialFlash_WriteGather(log->platform, address, chunks, 2, timeout_ms)) {
+        // The header may be missing, so nothing after it could be found: close the sector
+        log->writeOffset = SERIALFLASH_SECTOR_SIZE;
+        return false;
+    }
+
+    log->writeOffset += SERIALFLASHLOG_RECORD_HEADER_SIZE + length;
+    return true;
+}
+
+void SerialFlashLog_Rewind(const struct SerialFlashLog *log, struct SerialFlashLog_Cursor *cursor) {
+    cursor->sector = log->tail;
+    cursor->offset = SERIALFLASHLOG_HEADER_SIZE;
+}
+
+// Reads the record and checks it against its CRC, the part past size is checked with a second read
+static bool SerialFlashLog_ReadRecord(const struct SerialFlashLog *log, uint32_t address, uint32_t length, uint32_t crc,
+    uint8_t *data, uint32_t size, bool *intact, uint32_t timeout_ms) {
+    uint32_t actual;
+
+    if (!SerialFlash_Read(log->platform, address, data, length < size ? length : size, timeout_ms)) {
+        return false;
+    }
+
+    if (length <= size) {
+        actual = SerialFlash_Crc32(0, data, length);
+    } else if (!SerialFlash_Checksum(log->platform, address, length, &actual, timeout_ms)) {
+        return false;
+    }
+
+    *intact = actual == crc;
+    return true;
+}
+
+bool SerialFlashLog_Next(const struct SerialFlashLog *log, struct SerialFlashLog_Cursor *cursor,
+    uint8_t *data, uint32_t size, uint32_t *length, uint32_t timeout_ms) {
+    for (;;) {
+        if (cursor->sector == log->head && cursor->offset >= log->writeOffset) {
+            return false;
+        }
+
+        bool valid;
+        uint32_t crc;
+        if (!SerialFlashLog_ReadRecordHeader(log, cursor->sector, cursor->offset, &valid, length, &crc, timeout_ms)) {
+            return false;
+        }
+
+        if (!valid) {
+            // End of this sector
+            if (cursor->sector == log->head) {
+                return false;
+            }
+            cursor->sector = (cursor->sector + 1) % log->sectorCount;
+            cursor->offset = SERIALFLASHLOG_HEADER_SIZE;
+            continue;
+        }
+
+        uint32_t address = SerialFlashLog_SectorAddress(log, cursor->sector) + cursor->offset + SERIALFLASHLOG_RECORD_HEADER_SIZE;
+        cursor->offset += SERIALFLASHLOG_RECORD_HEADER_SIZE + *length;
+
+        // Torn or failed append, skipped
+        bool intact;
+        if (!SerialFlashLog_ReadRecord(log, address, *length, crc, data, size, &intact, timeout_ms)) {
+            return false;
+        }
+        if (intact) {
+            return true;
+        }
+    }
+}
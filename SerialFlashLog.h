@@ -0,0 +1,51 @@
+#ifndef SERIALFLASHLOG_H
+#define SERIALFLASHLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Circular append-only record log over a range of sectors.
+// Each sector starts with a header {magic, seq}, followed by records {u16 length, u16 ~length, u32 crc, data}.
+// A record is programmed in one write, records whose data doesn't match the CRC (torn or failed appends) are skipped.
+// Sectors are used in order and wrap around, the sector after the head is always kept erased,
+// so at mount the head is found by a binary search over sector headers.
+
+#define SERIALFLASHLOG_MAGIC 0x324C4653 // "SFL2"
+#define SERIALFLASHLOG_HEADER_SIZE 8
+#define SERIALFLASHLOG_RECORD_HEADER_SIZE 8
+#define SERIALFLASHLOG_RECORD_SIZE_MAX (SERIALFLASH_SECTOR_SIZE - SERIALFLASHLOG_HEADER_SIZE - SERIALFLASHLOG_RECORD_HEADER_SIZE)
+
+struct SerialFlashLog {
+    const struct SerialFlash_Platform *platform;
+    uint32_t base; // Sector aligned
+    uint32_t sectorCount; // At least 2
+
+    uint32_t head; // Sector being appended to
+    uint32_t headSeq;
+    uint32_t writeOffset; // Within the head sector
+    uint32_t tail; // Oldest sector with data
+};
+
+struct SerialFlashLog_Cursor {
+    uint32_t sector;
+    uint32_t offset;
+};
+
+// Erases the range and starts an empty log
+bool SerialFlashLog_Format(struct SerialFlashLog *log, const struct SerialFlash_Platform *platform,
+    uint32_t base, uint32_t sectorCount, uint32_t timeout_ms);
+// Finds the head and tail, starts an empty log if the range is blank
+bool SerialFlashLog_Mount(struct SerialFlashLog *log, const struct SerialFlash_Platform *platform,
+    uint32_t base, uint32_t sectorCount, uint32_t timeout_ms);
+
+// Records don't span sectors, the oldest sector is dropped when the log wraps
+bool SerialFlashLog_Append(struct SerialFlashLog *log, const uint8_t *data, uint32_t length, uint32_t timeout_ms);
+
+// Iterates records from the oldest one
+void SerialFlashLog_Rewind(const struct SerialFlashLog *log, struct SerialFlashLog_Cursor *cursor);
+// Returns false at the end of the log or on error. Records longer than size are truncated, length is the full one.
+bool SerialFlashLog_Next(const struct SerialFlashLog *log, struct SerialFlashLog_Cursor *cursor,
+    uint8_t *data, uint32_t size, uint32_t *length, uint32_t timeout_ms);
+
+#endif // SERIALFLASHLOG_H
@@ -0,0 +1,432 @@
+#include "SerialFlashSched.h"
+
+#define SERIALFLASHSCHED_SUSPEND_US 20 // tSUS, until the chip is ready after suspend
+#define SERIALFLASHSCHED_POLL_US 50 // SerialFlashSched_Wait() period between polls
+#define SERIALFLASHSCHED_RESUME_GAP_US 1000 // Default erase time between suspends
+
+static void SerialFlashSched_Lock(const struct SerialFlashSched *sched) {
+    if (sched->lock) {
+        sched->lock(sched->lockContext);
+    }
+}
+
+static void SerialFlashSched_Unlock(const struct SerialFlashSched *sched) {
+    if (sched->unlock) {
+        sched->unlock(sched->lockContext);
+    }
+}
+
+void SerialFlashSched_Init(struct SerialFlashSched *sched, const struct SerialFlash_Platform *platform, uint32_t timeout_ms) {
+    sched->platform = platform;
+    sched->lock = NULL;
+    sched->unlock = NULL;
+    sched->lockContext = NULL;
+    sched->suspend = true;
+    sched->resumeGapUs = SERIALFLASHSCHED_RESUME_GAP_US;
+    sched->timeout_ms = timeout_ms;
+
+    sched->queue = NULL;
+    sched->current = NULL;
+    sched->issued = NULL;
+    sched->busy = false;
+    sched->busyErase = false;
+    sched->busyPriority = 0;
+    sched->busyAddress = 0;
+    sched->busyLength = 0;
+    sched->suspended = false;
+    sched->resumeUs = 0;
+    sched->writeEnabled = false;
+
+    sched->suspends = 0;
+    sched->gathered = 0;
+}
+
+static void SerialFlashSched_Finish(struct SerialFlashSched_Request *request, bool ok) {
+    request->state = ok ? SERIALFLASHSCHED_DONE : SERIALFLASHSCHED_FAILED;
+    if (request->callback) {
+        request->callback(request, ok);
+    }
+}
+
+// Behind the requests of higher priority and, unless front, of the same priority
+static void SerialFlashSched_Insert(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, bool front) {
+    struct SerialFlashSched_Request **link = &sched->queue;
+    while (*link && ((*link)->priority > request->priority || (!front && (*link)->priority == request->priority))) {
+        link = &(*link)->next;
+    }
+
+    request->next = *link;
+    *link = request;
+}
+
+static void SerialFlashSched_Unlink(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request) {
+    for (struct SerialFlashSched_Request **link = &sched->queue; *link; link = &(*link)->next) {
+        if (*link == request) {
+            *link = request->next;
+            return;
+        }
+    }
+}
+
+static void SerialFlashSched_FinishList(struct SerialFlashSched_Request **list, bool ok) {
+    while (*list) {
+        struct SerialFlashSched_Request *request = *list;
+        *list = request->next;
+        SerialFlashSched_Finish(request, ok);
+    }
+}
+
+static bool SerialFlashSched_Submit(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, enum SerialFlashSched_Type type,
+        uint32_t address, uint32_t length, uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context) {
+    request->type = type;
+    request->priority = priority;
+    request->address = address;
+    request->length = length;
+    request->done = 0;
+    request->callback = callback;
+    request->context = context;
+
+    SerialFlashSched_Lock(sched);
+    if (length == 0) {
+        SerialFlashSched_Finish(request, true);
+    } else {
+        request->state = SERIALFLASHSCHED_QUEUED;
+        SerialFlashSched_Insert(sched, request, false);
+    }
+    SerialFlashSched_Unlock(sched);
+
+    return true;
+}
+
+bool SerialFlashSched_Read(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t address, uint8_t *buffer, uint32_t length,
+        uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context) {
+    request->buffer = buffer;
+    request->data = NULL;
+
+    return SerialFlashSched_Submit(sched, request, SERIALFLASHSCHED_READ, address, length, priority, callback, context);
+}
+
+bool SerialFlashSched_Write(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t address, const uint8_t *data, uint32_t length,
+        uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context) {
+    request->buffer = NULL;
+    request->data = data;
+
+    return SerialFlashSched_Submit(sched, request, SERIALFLASHSCHED_WRITE, address, length, priority, callback, context);
+}
+
+bool SerialFlashSched_Erase(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t address, uint32_t length,
+        uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context) {
+    // Same checks as SerialFlash_Erase
+    if (!SerialFlash_PlanErase(sched->platform, address, length, NULL, 0, NULL, NULL)) {
+        return false;
+    }
+
+    request->buffer = NULL;
+    request->data = NULL;
+
+    return SerialFlashSched_Submit(sched, request, SERIALFLASHSCHED_ERASE, address, length, priority, callback, context);
+}
+
+// Queued read that may run before the command in flight is finished
+static struct SerialFlashSched_Request *SerialFlashSched_UrgentRead(const struct SerialFlashSched *sched) {
+    struct SerialFlashSched_Request *head = sched->queue;
+    if (!head || head->type != SERIALFLASHSCHED_READ || head->priority <= sched->busyPriority) {
+        return NULL;
+    }
+
+    // Not from the block being erased
+    if (head->address < sched->busyAddress + sched->busyLength && sched->busyAddress < head->address + head->length) {
+        return NULL;
+    }
+
+    return head;
+}
+
+static bool SerialFlashSched_Resume(struct SerialFlashSched *sched) {
+    const struct SerialFlash_Platform *platform = sched->platform;
+    if (!SerialFlash_Resume(platform)) {
+        return false;
+    }
+
+    sched->suspended = false;
+    sched->resumeUs = platform->getTimeUs();
+    return true;
+}
+
+// Suspends the erase in flight for the reads that outrank it
+static void SerialFlashSched_ReadSuspended(struct SerialFlashSched *sched) {
+    const struct SerialFlash_Platform *platform = sched->platform;
+    if (!platform->getTimeUs || !SerialFlashSched_UrgentRead(sched) ||
+        (sched->suspends > 0 && platform->getTimeUs() - sched->resumeUs < sched->resumeGapUs)) {
+        return;
+    }
+
+    if (!SerialFlash_Suspend(platform)) {
+        return;
+    }
+    sched->suspended = true;
+    sched->suspends++;
+    platform->delayUs(SERIALFLASHSCHED_SUSPEND_US);
+
+    uint8_t sr1;
+    if (SerialFlash_ReadStatus(platform, SERIALFLASH_SR1, &sr1) && !(sr1 & SERIALFLASH_SR1_BUSY)) {
+        struct SerialFlashSched_Request *request;
+        while ((request = SerialFlashSched_UrgentRead(sched)) != NULL) {
+            sched->queue = request->next;
+            SerialFlashSched_Finish(request, SerialFlash_Read(platform, request->address, request->buffer, request->length, sched->timeout_ms));
+        }
+    }
+
+    // SUS is clear if the erase completed before the suspend, resume when unsure
+    uint8_t sr2;
+    if (SerialFlash_ReadStatus(platform, SERIALFLASH_SR2, &sr2) && !(sr2 & SERIALFLASH_SR2_SUS)) {
+        sched->suspended = false;
+        return;
+    }
+
+    // Retried by the next poll if it fails
+    SerialFlashSched_Resume(sched);
+}
+
+static bool SerialFlashSched_EraseStep(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request) {
+    const struct SerialFlash_Platform *platform = sched->platform;
+
+    // First step of the plan of the rest
+    struct SerialFlash_EraseStep step;
+    if (!SerialFlash_PlanErase(platform, request->address + request->done, request->length - request->done, &step, 1, NULL, NULL)) {
+        return false;
+    }
+
+    bool ok = SerialFlash_SetWriteEnable(platform, true);
+    switch (step.size) {
+    case SERIALFLASH_SECTOR_SIZE:
+        ok = ok && SerialFlash_SectorErase(platform, step.address);
+        break;
+    case SERIALFLASH_BLOCK32K_SIZE:
+        ok = ok && SerialFlash_BlockErase(platform, step.address, false);
+        break;
+    case SERIALFLASH_BLOCK_SIZE:
+        ok = ok && SerialFlash_BlockErase(platform, step.address, true);
+        break;
+    default:
+        ok = ok && SerialFlash_ChipErase(platform);
+        break;
+    }
+
+    // Chip erase can't be suspended
+    sched->busyErase = step.size <= SERIALFLASH_BLOCK_SIZE;
+    sched->busyAddress = step.address;
+    sched->busyLength = step.size;
+    request->done = step.address + step.size - request->address;
+
+    return ok;
+}
+
+// A queued read ahead of the write overlaps the rest of it, and would see its data if it rode along
+static bool SerialFlashSched_ReadAhead(const struct SerialFlashSched *sched, const struct SerialFlashSched_Request *write) {
+    uint32_t start = write->address + write->done;
+    uint32_t end = write->address + write->length;
+
+    for (const struct SerialFlashSched_Request *queued = sched->queue; queued != write; queued = queued->next) {
+        if (queued->type == SERIALFLASHSCHED_READ && queued->address < end && start < queued->address + queued->length) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Programs the current write up to the end of its page, continued by the queued writes that follow it
+static bool SerialFlashSched_ProgramStep(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request) {
+    const struct SerialFlash_Platform *platform = sched->platform;
+    const struct SerialFlash_Descriptor *descriptor = platform->state ? &platform->state->descriptor : NULL;
+    uint32_t pageSize = SERIALFLASH_PAGE_SIZE;
+    if (descriptor && descriptor->valid && descriptor->pageSize && descriptor->pageSize < pageSize) {
+        pageSize = descriptor->pageSize;
+    }
+
+    uint32_t address = request->address + request->done;
+    uint32_t pageEnd = (address / pageSize + 1) * pageSize;
+
+    struct SerialFlash_Chunk chunks[SERIALFLASH_GATHER_CHUNKS_MAX];
+    struct SerialFlashSched_Request *owners[SERIALFLASH_GATHER_CHUNKS_MAX];
+    uint32_t count = 0;
+
+    for (uint32_t cur = address; request && count < SERIALFLASH_GATHER_CHUNKS_MAX; ) {
+        uint32_t length = request->length - request->done;
+        if (length > pageEnd - cur) {
+            length = pageEnd - cur;
+        }
+
+        chunks[count].data = request->data + request->done;
+        chunks[count].length = length;
+        owners[count++] = request;
+        request->done += length;
+        request->state = SERIALFLASHSCHED_RUNNING;
+        cur += length;
+
+        if (cur == pageEnd) {
+            break;
+        }
+
+        // Next queued write starting here, not past an erase that may have to come first
+        // nor ahead of a read of its range queued before it
+        struct SerialFlashSched_Request *next = NULL;
+        for (struct SerialFlashSched_Request *queued = sched->queue; queued && queued->type != SERIALFLASHSCHED_ERASE; queued = queued->next) {
+            if (queued->type == SERIALFLASHSCHED_WRITE && queued->done < queued->length && queued->address + queued->done == cur) {
+                if (!SerialFlashSched_ReadAhead(sched, queued)) {
+                    next = queued;
+                }
+                break;
+            }
+        }
+        request = next;
+    }
+
+    // Pieces of other requests ride along, finished writes wait in issued for the chip to be ready
+    sched->busyErase = false;
+    sched->busyAddress = address;
+    sched->busyLength = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        struct SerialFlashSched_Request *owner = owners[i];
+        sched->busyLength += chunks[i].length;
+        if (owner != sched->current) {
+            sched->gathered++;
+            if (owner->done == owner->length) {
+                SerialFlashSched_Unlink(sched, owner);
+                owner->next = sched->issued;
+                sched->issued = owner;
+            }
+        }
+    }
+
+    if (SerialFlash_SetWriteEnable(platform, true) && SerialFlash_PageProgramGather(platform, address, chunks, count)) {
+        return true;
+    }
+
+    // Riders with more pages to go fail here, the finished ones with the issued list
+    for (uint32_t i = 0; i < count; i++) {
+        struct SerialFlashSched_Request *owner = owners[i];
+        if (owner != sched->current && owner->done < owner->length) {
+            SerialFlashSched_Unlink(sched, owner);
+            SerialFlashSched_Finish(owner, false);
+        }
+    }
+
+    return false;
+}
+
+// Issues the next command of the current request
+static void SerialFlashSched_Issue(struct SerialFlashSched *sched) {
+    struct SerialFlashSched_Request *request = sched->current;
+
+    sched->busyPriority = request->priority;
+    sched->writeEnabled = true;
+
+    bool ok = request->type == SERIALFLASHSCHED_ERASE ? SerialFlashSched_EraseStep(sched, request) :
+        SerialFlashSched_ProgramStep(sched, request);
+
+    if (request->done == request->length) {
+        sched->current = NULL;
+        request->next = sched->issued;
+        sched->issued = request;
+    }
+
+    if (!ok) {
+        // Everything the command carried failed
+        if (sched->current) {
+            sched->current = NULL;
+            SerialFlashSched_Finish(request, false);
+        }
+        SerialFlashSched_FinishList(&sched->issued, false);
+        return;
+    }
+
+    sched->busy = true;
+}
+
+// Chip is ready: the reads and the writes/erases that outrank the current request, then its next command
+static void SerialFlashSched_Step(struct SerialFlashSched *sched) {
+    for (;;) {
+        struct SerialFlashSched_Request *head = sched->queue;
+        if (sched->current && (!head || head->priority <= sched->current->priority)) {
+            SerialFlashSched_Issue(sched);
+            return;
+        }
+
+        if (!head) {
+            // One write disable per batch of programs/erases rather than per request
+            if (sched->writeEnabled) {
+                SerialFlash_SetWriteEnable(sched->platform, false);
+                sched->writeEnabled = false;
+            }
+            return;
+        }
+
+        sched->queue = head->next;
+        if (head->type == SERIALFLASHSCHED_READ) {
+            SerialFlashSched_Finish(head, SerialFlash_Read(sched->platform, head->address, head->buffer, head->length, sched->timeout_ms));
+            continue;
+        }
+
+        // Preempted, resumes before the requests queued after it
+        if (sched->current) {
+            SerialFlashSched_Insert(sched, sched->current, true);
+        }
+        sched->current = head;
+    }
+}
+
+bool SerialFlashSched_Poll(struct SerialFlashSched *sched) {
+    SerialFlashSched_Lock(sched);
+
+    // A suspended chip reads as ready, nothing may run until it is resumed
+    if (sched->suspended && !SerialFlashSched_Resume(sched)) {
+        SerialFlashSched_Unlock(sched);
+        return true;
+    }
+
+    if (sched->busy) {
+        uint8_t sr1;
+        if (!SerialFlash_ReadStatus(sched->platform, SERIALFLASH_SR1, &sr1)) {
+            sched->busy = false;
+            SerialFlashSched_FinishList(&sched->issued, false);
+            if (sched->current) {
+                SerialFlashSched_Finish(sched->current, false);
+                sched->current = NULL;
+            }
+        } else if (sr1 & SERIALFLASH_SR1_BUSY) {
+            if (sched->busyErase && sched->suspend) {
+                SerialFlashSched_ReadSuspended(sched);
+            }
+            SerialFlashSched_Unlock(sched);
+            return true;
+        } else {
+            sched->busy = false;
+            SerialFlashSched_FinishList(&sched->issued, true);
+        }
+    }
+
+    SerialFlashSched_Step(sched);
+
+    bool pending = sched->busy || sched->current || sched->queue;
+    SerialFlashSched_Unlock(sched);
+
+    return pending;
+}
+
+bool SerialFlashSched_Wait(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t timeout_ms) {
+    uint32_t timeoutUs = timeout_ms * 1000;
+    for (uint32_t elapsedUs = 0; ; elapsedUs += SERIALFLASHSCHED_POLL_US) {
+        SerialFlashSched_Poll(sched);
+
+        if (request->state == SERIALFLASHSCHED_DONE || request->state == SERIALFLASHSCHED_FAILED) {
+            return request->state == SERIALFLASHSCHED_DONE;
+        }
+        if (elapsedUs >= timeoutUs) {
+            return false;
+        }
+
+        sched->platform->delayUs(SERIALFLASHSCHED_POLL_US);
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef SERIALFLASHSCHED_H
+#define SERIALFLASHSCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Priority scheduler for several threads sharing one chip. Requests are queued by priority
+// (FIFO within a priority) and run by SerialFlashSched_Poll() one erase/program command at a time,
+// so an urgent request waits behind at most one command: a higher priority write or erase takes
+// over at the next command, reads go between the commands or, with erase suspend, in the middle of
+// an erase. Writes contiguous to the one being programmed share its page programs.
+// Requests on overlapping ranges keep their order only when submitted with the same priority.
+
+enum SerialFlashSched_Type {
+    SERIALFLASHSCHED_READ = 0,
+    SERIALFLASHSCHED_WRITE = 1,
+    SERIALFLASHSCHED_ERASE = 2
+};
+
+enum SerialFlashSched_State {
+    SERIALFLASHSCHED_IDLE = 0,
+    SERIALFLASHSCHED_QUEUED = 1,
+    SERIALFLASHSCHED_RUNNING = 2, // Part of it is erased/programmed
+    SERIALFLASHSCHED_DONE = 3,
+    SERIALFLASHSCHED_FAILED = 4
+};
+
+// Owned by the caller, must stay valid (with its buffer) until finished
+struct SerialFlashSched_Request {
+    enum SerialFlashSched_Type type;
+    volatile enum SerialFlashSched_State state;
+    uint8_t priority; // Higher runs first
+
+    uint32_t address;
+    uint32_t length;
+    uint32_t done; // Bytes erased/programmed (or issued) so far
+    uint8_t *buffer; // Read into
+    const uint8_t *data; // Written from
+
+    // Called from SerialFlashSched_Poll() with the lock held
+    void (*callback)(struct SerialFlashSched_Request *request, bool ok);
+    void *context; // User data
+
+    struct SerialFlashSched_Request *next; // Queue link
+};
+
+struct SerialFlashSched {
+    const struct SerialFlash_Platform *platform;
+
+    // Guards the queue and the bus, provided by the platform port (e.g. an RTOS mutex). NULL for a single thread.
+    void (*lock)(void *context);
+    void (*unlock)(void *context);
+    void *lockContext;
+
+    bool suspend; // Reads may suspend a running erase (the chip supports Erase Suspend), needs platform->getTimeUs
+    uint32_t resumeGapUs; // Erase time between a resume and the next suspend, so a stream of reads can't stall it
+    uint32_t timeout_ms; // Of a single read
+
+    struct SerialFlashSched_Request *queue; // Priority order
+    struct SerialFlashSched_Request *current; // Erase/write with more commands to issue
+    struct SerialFlashSched_Request *issued; // Last command in flight, finished once the chip is ready
+
+    // Command in flight
+    bool busy;
+    bool busyErase; // Suspendable erase
+    uint8_t busyPriority;
+    uint32_t busyAddress;
+    uint32_t busyLength;
+
+    bool suspended; // Resume still to be sent
+    uint32_t resumeUs; // Time of the last resume
+
+    bool writeEnabled; // WEL may be left set, cleared once the queue has no more erases/programs
+
+    uint32_t suspends; // Erase suspends for reads
+    uint32_t gathered; // Write pieces programmed along with another request
+};
+
+void SerialFlashSched_Init(struct SerialFlashSched *sched, const struct SerialFlash_Platform *platform, uint32_t timeout_ms);
+
+// Queue a request, no SPI transfers. Erase ranges are checked as for SerialFlash_Erase(),
+// write targets must be erased as for SerialFlash_Write().
+bool SerialFlashSched_Read(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t address, uint8_t *buffer, uint32_t length,
+    uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context);
+bool SerialFlashSched_Write(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t address, const uint8_t *data, uint32_t length,
+    uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context);
+bool SerialFlashSched_Erase(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t address, uint32_t length,
+    uint8_t priority, void (*callback)(struct SerialFlashSched_Request *request, bool ok), void *context);
+
+// One status read, the reads that outrank the command in flight and at most one erase/program command.
+// Call from a flash task or any thread until it returns false (queue empty and chip ready).
+bool SerialFlashSched_Poll(struct SerialFlashSched *sched);
+// Polls until the request is finished, for blocking callers
+bool SerialFlashSched_Wait(struct SerialFlashSched *sched, struct SerialFlashSched_Request *request, uint32_t timeout_ms);
+
+#endif // SERIALFLASHSCHED_H
@@ -0,0 +1,954 @@
+#include <string.h>
+#include "BitOps.h"
+#include "SerialFlashSim.h"
+
+#define SERIALFLASHSIM_CMD_WRITE_ENABLE 0x06
+#define SERIALFLASHSIM_CMD_WRITE_DISABLE 0x04
+
+#define SERIALFLASHSIM_CMD_RELEASE_POW_DOWN 0xAB
+#define SERIALFLASHSIM_CMD_MANUF_DEV_ID 0x90
+#define SERIALFLASHSIM_CMD_UNIQUE_ID 0x4B
+
+#define SERIALFLASHSIM_CMD_READ_DATA 0x03
+#define SERIALFLASHSIM_CMD_FAST_READ 0x0B
+
+#define SERIALFLASHSIM_CMD_PAGE_PROGRAM 0x02
+#define SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM 0x32
+
+#define SERIALFLASHSIM_CMD_SECTOR_ERASE 0x20
+#define SERIALFLASHSIM_CMD_BLOCK32K_ERASE 0x52
+#define SERIALFLASHSIM_CMD_BLOCK64K_ERASE 0xD8
+#define SERIALFLASHSIM_CMD_CHIP_ERASE 0xC7
+#define SERIALFLASHSIM_CMD_CHIP_ERASE_ALT 0x60
+
+#define SERIALFLASHSIM_CMD_READ_STATUS1 0x05
+#define SERIALFLASHSIM_CMD_WRITE_STATUS1 0x01
+#define SERIALFLASHSIM_CMD_READ_STATUS2 0x35
+#define SERIALFLASHSIM_CMD_WRITE_STATUS2 0x31
+#define SERIALFLASHSIM_CMD_READ_STATUS3 0x15
+#define SERIALFLASHSIM_CMD_WRITE_STATUS3 0x11
+
+#define SERIALFLASHSIM_CMD_GLOBAL_BLOCK_LOCK 0x7E
+#define SERIALFLASHSIM_CMD_GLOBAL_BLOCK_UNLOCK 0x98
+#define SERIALFLASHSIM_CMD_INDIV_BLOCK_LOCK 0x36
+#define SERIALFLASHSIM_CMD_INDIV_BLOCK_UNLOCK 0x39
+
+#define SERIALFLASHSIM_CMD_POWER_DOWN 0xB9
+
+#define SERIALFLASHSIM_CMD_ENABLE_RESET 0x66
+#define SERIALFLASHSIM_CMD_RESET 0x99
+
+#define SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT 0x3B
+#define SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT 0x6B
+#define SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO 0xBB
+#define SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO 0xEB
+
+#define SERIALFLASHSIM_CMD_SUSPEND 0x75
+#define SERIALFLASHSIM_CMD_RESUME 0x7A
+
+#define SERIALFLASHSIM_CMD_READ_SFDP 0x5A
+
+#define SERIALFLASHSIM_CMD_ENTER_4BYTE_MODE 0xB7
+#define SERIALFLASHSIM_CMD_EXIT_4BYTE_MODE 0xE9
+
+// Dedicated 4-byte address instructions, executed as their 3-byte forms
+#define SERIALFLASHSIM_CMD_READ_DATA_4B 0x13
+#define SERIALFLASHSIM_CMD_FAST_READ_4B 0x0C
+#define SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT_4B 0x3C
+#define SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT_4B 0x6C
+#define SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO_4B 0xBC
+#define SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO_4B 0xEC
+#define SERIALFLASHSIM_CMD_PAGE_PROGRAM_4B 0x12
+#define SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM_4B 0x34
+#define SERIALFLASHSIM_CMD_SECTOR_ERASE_4B 0x21
+#define SERIALFLASHSIM_CMD_BLOCK64K_ERASE_4B 0xDC
+
+#define SERIALFLASHSIM_CMD_MODE_RESET 0xFF
+
+#define SERIALFLASHSIM_SR1_BUSY BITOPS_BIT(0)
+#define SERIALFLASHSIM_SR1_WEL BITOPS_BIT(1)
+#define SERIALFLASHSIM_SR2_QE BITOPS_BIT(1)
+#define SERIALFLASHSIM_SR2_SUS BITOPS_BIT(7)
+#define SERIALFLASHSIM_MODE_CONTINUOUS_MASK 0x30 // M5-4
+#define SERIALFLASHSIM_MODE_CONTINUOUS 0x20
+#define SERIALFLASHSIM_SR1_WRITABLE 0xFC // SRP0, SEC, TB, BP0-2
+#define SERIALFLASHSIM_SR2_WRITABLE 0x43 // CMP, QE, SRP1
+#define SERIALFLASHSIM_SR2_OTP 0x38 // LB1-3, can only be set
+#define SERIALFLASHSIM_SR3_WRITABLE 0xF4 // HOLD/RST, DRV, HFM, WPS
+#define SERIALFLASHSIM_SR3_ADS BITOPS_BIT(0) // Current address mode, 1 for 4-byte
+
+#define SERIALFLASHSIM_RESET_TIME_US 30
+#define SERIALFLASHSIM_SUSPEND_TIME_US 20
+
+#define SERIALFLASHSIM_SFDP_SIZE 256
+#define SERIALFLASHSIM_SFDP_BFPT 0x30
+#define SERIALFLASHSIM_SFDP_BFPT_DWORDS 16
+
+#define SERIALFLASHSIM_PS_PER_NS 1000ull
+#define SERIALFLASHSIM_PS_PER_US 1000000ull
+#define SERIALFLASHSIM_PS_PER_S 1000000000000ull
+
+static struct {
+    struct SerialFlashSim_Config config;
+    struct SerialFlashSim_Stats stats;
+
+    // Time in picoseconds to keep sub-nanosecond clock periods exact enough
+    uint64_t nowPs;
+    uint64_t busyUntilPs;
+    uint64_t busPs;
+    uint64_t busyPs;
+    uint64_t delayPs;
+    bool busy;
+    bool suspendable; // Current operation is a page program or a sector/block erase
+    uint64_t suspendedPs; // Remaining time of the suspended operation
+
+    uint8_t sfdp[SERIALFLASHSIM_SFDP_SIZE];
+
+    uint8_t sr1; // BUSY is derived from busy
+    uint8_t sr2;
+    uint8_t sr3;
+    bool powerDown;
+    bool resetEnabled;
+    bool continuous; // Quad I/O continuous read mode, frames start with the address
+
+    // Current transaction
+    bool selected;
+    bool ignored;
+    uint8_t command; // Opcode as sent
+    uint8_t opcode; // 4-byte instructions mapped to their 3-byte forms
+    uint32_t addressBytes; // 3 or 4
+    uint32_t position;
+    uint32_t start; // Position of the first byte of the frame
+    uint32_t headerLength;
+    uint32_t address;
+    uint32_t dataLength;
+    uint8_t mode; // M7-0 of Dual/Quad I/O reads
+    uint8_t status[2];
+    uint8_t page[SERIALFLASH_PAGE_SIZE];
+} sim;
+
+static void SerialFlashSim_Update(void) {
+    if (sim.busy && sim.nowPs >= sim.busyUntilPs) {
+        sim.busy = false;
+        sim.sr1 &= ~SERIALFLASHSIM_SR1_WEL;
+    }
+}
+
+static void SerialFlashSim_StartBusy(uint32_t us, bool suspendable) {
+    sim.busy = true;
+    sim.suspendable = suspendable;
+    sim.busyUntilPs = sim.nowPs + us * SERIALFLASHSIM_PS_PER_US;
+    sim.busyPs += us * SERIALFLASHSIM_PS_PER_US;
+}
+
+static void SerialFlashSim_Clock(uint32_t cycles) {
+    uint64_t ps = cycles * (SERIALFLASHSIM_PS_PER_S / sim.config.clockHz);
+
+    sim.stats.clockCycles += cycles;
+    sim.busPs += ps;
+    sim.nowPs += ps;
+    SerialFlashSim_Update();
+}
+
+// Maps a 4-byte address instruction to its 3-byte form
+static uint8_t SerialFlashSim_Opcode3B(uint8_t opcode, bool *address4) {
+    static const uint8_t map[][2] = {
+        { SERIALFLASHSIM_CMD_READ_DATA_4B, SERIALFLASHSIM_CMD_READ_DATA },
+        { SERIALFLASHSIM_CMD_FAST_READ_4B, SERIALFLASHSIM_CMD_FAST_READ },
+        { SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT_4B, SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT },
+        { SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT_4B, SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT },
+        { SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO_4B, SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO },
+        { SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO_4B, SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO },
+        { SERIALFLASHSIM_CMD_PAGE_PROGRAM_4B, SERIALFLASHSIM_CMD_PAGE_PROGRAM },
+        { SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM_4B, SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM },
+        { SERIALFLASHSIM_CMD_SECTOR_ERASE_4B, SERIALFLASHSIM_CMD_SECTOR_ERASE },
+        { SERIALFLASHSIM_CMD_BLOCK64K_ERASE_4B, SERIALFLASHSIM_CMD_BLOCK64K_ERASE }
+    };
+
+    for (uint32_t i = 0; i < sizeof(map) / sizeof(map[0]); i++) {
+        if (map[i][0] == opcode) {
+            *address4 = true;
+            return map[i][1];
+        }
+    }
+
+    return opcode;
+}
+
+// Array address commands, their address follows the address mode
+static bool SerialFlashSim_HasArrayAddress(uint8_t opcode) {
+    switch (opcode) {
+    case SERIALFLASHSIM_CMD_READ_DATA:
+    case SERIALFLASHSIM_CMD_FAST_READ:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO:
+    case SERIALFLASHSIM_CMD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_SECTOR_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK32K_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK64K_ERASE:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_LOCK:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_UNLOCK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// With 3 address bytes
+static uint32_t SerialFlashSim_HeaderLength(uint8_t opcode) {
+    switch (opcode) {
+    case SERIALFLASHSIM_CMD_READ_DATA:
+    case SERIALFLASHSIM_CMD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_SECTOR_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK32K_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK64K_ERASE:
+    case SERIALFLASHSIM_CMD_MANUF_DEV_ID:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_LOCK:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_UNLOCK:
+    case SERIALFLASHSIM_CMD_RELEASE_POW_DOWN:
+        return 4;
+    case SERIALFLASHSIM_CMD_FAST_READ:
+    case SERIALFLASHSIM_CMD_UNIQUE_ID:
+    case SERIALFLASHSIM_CMD_READ_SFDP:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO: // Address, M7-0
+        return 5;
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO: // Address, M7-0, 4 dummy clocks
+        return 7;
+    default:
+        return 1;
+    }
+}
+
+// Data lines expected after the opcode, in the header and in the data phase
+static int SerialFlashSim_Lines(uint8_t opcode, bool data) {
+    switch (opcode) {
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+        return data ? 2 : 1;
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+        return data ? 4 : 1;
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO:
+        return 2;
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO:
+        return 4;
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM:
+        return data ? 4 : 1;
+    default:
+        return 1;
+    }
+}
+
+static bool SerialFlashSim_IsArrayRead(uint8_t opcode) {
+    switch (opcode) {
+    case SERIALFLASHSIM_CMD_READ_DATA:
+    case SERIALFLASHSIM_CMD_FAST_READ:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool SerialFlashSim_IsQuad(uint8_t opcode) {
+    return opcode == SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT || opcode == SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO ||
+        opcode == SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM;
+}
+
+static bool SerialFlashSim_IsProgram(uint8_t opcode) {
+    return opcode == SERIALFLASHSIM_CMD_PAGE_PROGRAM || opcode == SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM;
+}
+
+static bool SerialFlashSim_IsKnown(uint8_t opcode) {
+    switch (opcode) {
+    case SERIALFLASHSIM_CMD_WRITE_ENABLE:
+    case SERIALFLASHSIM_CMD_WRITE_DISABLE:
+    case SERIALFLASHSIM_CMD_RELEASE_POW_DOWN:
+    case SERIALFLASHSIM_CMD_MANUF_DEV_ID:
+    case SERIALFLASHSIM_CMD_UNIQUE_ID:
+    case SERIALFLASHSIM_CMD_READ_DATA:
+    case SERIALFLASHSIM_CMD_FAST_READ:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO:
+    case SERIALFLASHSIM_CMD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_SECTOR_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK32K_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK64K_ERASE:
+    case SERIALFLASHSIM_CMD_CHIP_ERASE:
+    case SERIALFLASHSIM_CMD_CHIP_ERASE_ALT:
+    case SERIALFLASHSIM_CMD_READ_STATUS1:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS1:
+    case SERIALFLASHSIM_CMD_READ_STATUS2:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS2:
+    case SERIALFLASHSIM_CMD_READ_STATUS3:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS3:
+    case SERIALFLASHSIM_CMD_GLOBAL_BLOCK_LOCK:
+    case SERIALFLASHSIM_CMD_GLOBAL_BLOCK_UNLOCK:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_LOCK:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_UNLOCK:
+    case SERIALFLASHSIM_CMD_POWER_DOWN:
+    case SERIALFLASHSIM_CMD_ENABLE_RESET:
+    case SERIALFLASHSIM_CMD_RESET:
+    case SERIALFLASHSIM_CMD_SUSPEND:
+    case SERIALFLASHSIM_CMD_RESUME:
+    case SERIALFLASHSIM_CMD_READ_SFDP:
+    case SERIALFLASHSIM_CMD_ENTER_4BYTE_MODE:
+    case SERIALFLASHSIM_CMD_EXIT_4BYTE_MODE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool SerialFlashSim_IsModifying(uint8_t opcode) {
+    switch (opcode) {
+    case SERIALFLASHSIM_CMD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_SECTOR_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK32K_ERASE:
+    case SERIALFLASHSIM_CMD_BLOCK64K_ERASE:
+    case SERIALFLASHSIM_CMD_CHIP_ERASE:
+    case SERIALFLASHSIM_CMD_CHIP_ERASE_ALT:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS1:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS2:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS3:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool SerialFlashSim_Accepts(uint8_t opcode) {
+    if (sim.powerDown) {
+        return opcode == SERIALFLASHSIM_CMD_RELEASE_POW_DOWN;
+    }
+
+    if (sim.busy) {
+        // Only status reads and suspend are allowed during embedded operations
+        return opcode == SERIALFLASHSIM_CMD_READ_STATUS1 ||
+            opcode == SERIALFLASHSIM_CMD_READ_STATUS2 ||
+            opcode == SERIALFLASHSIM_CMD_READ_STATUS3 ||
+            opcode == SERIALFLASHSIM_CMD_SUSPEND;
+    }
+
+    // Another erase/program can't start while one is suspended
+    if ((sim.sr2 & SERIALFLASHSIM_SR2_SUS) && SerialFlashSim_IsModifying(opcode)) {
+        return false;
+    }
+
+    // IO2/IO3 are WP#/HOLD# unless QE is set
+    if (SerialFlashSim_IsQuad(opcode) && !(sim.sr2 & SERIALFLASHSIM_SR2_QE)) {
+        return false;
+    }
+
+    return SerialFlashSim_IsKnown(opcode);
+}
+
+static uint8_t SerialFlashSim_DataByte(uint8_t in) {
+    uint8_t out = 0xFF;
+
+    switch (sim.opcode) {
+    case SERIALFLASHSIM_CMD_READ_DATA:
+    case SERIALFLASHSIM_CMD_FAST_READ:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO:
+        out = sim.config.memory[sim.address];
+        sim.address = (sim.address + 1) % sim.config.capacity;
+        sim.stats.bytesRead++;
+        break;
+    case SERIALFLASHSIM_CMD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM:
+        // Data wraps around within the page, the last bytes win
+        sim.page[(sim.address + sim.dataLength) % SERIALFLASH_PAGE_SIZE] = in;
+        break;
+    case SERIALFLASHSIM_CMD_READ_STATUS1:
+        // Repeated output, reflects the current state
+        out = sim.sr1 | (sim.busy ? SERIALFLASHSIM_SR1_BUSY : 0);
+        break;
+    case SERIALFLASHSIM_CMD_READ_STATUS2:
+        out = sim.sr2;
+        break;
+    case SERIALFLASHSIM_CMD_READ_STATUS3:
+        out = sim.sr3;
+        break;
+    case SERIALFLASHSIM_CMD_WRITE_STATUS1:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS2:
+    case SERIALFLASHSIM_CMD_WRITE_STATUS3:
+        if (sim.dataLength < sizeof(sim.status)) {
+            sim.status[sim.dataLength] = in;
+        }
+        break;
+    case SERIALFLASHSIM_CMD_MANUF_DEV_ID:
+        out = ((sim.dataLength + (sim.address & 1)) % 2 == 0) ? sim.config.manufId : sim.config.devId;
+        break;
+    case SERIALFLASHSIM_CMD_UNIQUE_ID:
+        out = sim.config.uniqueId[sim.dataLength % sizeof(sim.config.uniqueId)];
+        break;
+    case SERIALFLASHSIM_CMD_RELEASE_POW_DOWN:
+        out = sim.config.devId;
+        break;
+    case SERIALFLASHSIM_CMD_READ_SFDP:
+        out = sim.sfdp[(sim.address + sim.dataLength) % SERIALFLASHSIM_SFDP_SIZE];
+        break;
+    default:
+        break;
+    }
+
+    sim.dataLength++;
+    return out;
+}
+
+static uint8_t SerialFlashSim_ShiftByte(uint8_t in, int lines) {
+    uint8_t out = 0xFF;
+
+    if (sim.position == 0) {
+        bool address4 = (sim.sr3 & SERIALFLASHSIM_SR3_ADS) != 0;
+        sim.command = in;
+        sim.opcode = SerialFlashSim_Opcode3B(in, &address4);
+        sim.addressBytes = (address4 && SerialFlashSim_HasArrayAddress(sim.opcode)) ? 4 : 3;
+        sim.headerLength = SerialFlashSim_HeaderLength(sim.opcode) + sim.addressBytes - 3;
+        sim.ignored = lines != 1 || !SerialFlashSim_Accepts(sim.opcode);
+        if (SerialFlashSim_IsProgram(sim.opcode)) {
+            memset(sim.page, 0xFF, sizeof(sim.page));
+        }
+    } else if (lines != SerialFlashSim_Lines(sim.opcode, sim.position >= sim.headerLength)) {
+        // Wrong bus width for this phase, the transaction is garbage
+        sim.ignored = true;
+    } else if (sim.position < sim.headerLength) {
+        // Address bytes, followed by mode and dummy bytes if any
+        if (sim.position <= sim.addressBytes) {
+            sim.address = ((sim.address << 8) | in) % sim.config.capacity;
+        } else if (sim.position == sim.addressBytes + 1) {
+            sim.mode = in;
+        }
+    } else if (!sim.ignored) {
+        out = SerialFlashSim_DataByte(in);
+    }
+
+    sim.position++;
+    return out;
+}
+
+static void SerialFlashSim_Shift(const uint8_t *tx, uint8_t *rx, uint32_t length, int lines) {
+    if (!sim.selected) {
+        sim.stats.protocolErrors++;
+        if (rx) {
+            memset(rx, 0xFF, length);
+        }
+        return;
+    }
+
+    uint32_t cyclesPerByte = 8 / lines;
+
+    for (uint32_t i = 0; i < length; ) {
+        bool dataPhase = sim.position > 0 && sim.position >= sim.headerLength;
+        if (rx && dataPhase && SerialFlashSim_IsArrayRead(sim.opcode) && !sim.ignored && lines == SerialFlashSim_Lines(sim.opcode, true)) {
+            // Bulk array read, wraps around at the end of the array
+            uint32_t count = length - i;
+            uint32_t chunk = sim.config.capacity - sim.address;
+            if (chunk > count) {
+                chunk = count;
+            }
+            memcpy(&rx[i], &sim.config.memory[sim.address], chunk);
+
+            sim.address = (sim.address + chunk) % sim.config.capacity;
+            sim.position += chunk;
+            sim.dataLength += chunk;
+            sim.stats.bytesRead += chunk;
+            SerialFlashSim_Clock(chunk * cyclesPerByte);
+            i += chunk;
+            continue;
+        }
+
+        uint8_t out = SerialFlashSim_ShiftByte(tx ? tx[i] : 0xFF, lines);
+        if (rx) {
+            rx[i] = out;
+        }
+        SerialFlashSim_Clock(cyclesPerByte);
+        i++;
+    }
+}
+
+static bool SerialFlashSim_WriteEnabled(void) {
+    return (sim.sr1 & SERIALFLASHSIM_SR1_WEL) != 0;
+}
+
+static void SerialFlashSim_EraseArray(uint32_t size, uint32_t timeUs) {
+    uint32_t address = sim.address & ~(size - 1);
+    memset(&sim.config.memory[address], 0xFF, size);
+    SerialFlashSim_StartBusy(timeUs, size < sim.config.capacity);
+}
+
+static bool SerialFlashSim_Execute(void) {
+    bool header = sim.position >= sim.headerLength;
+    bool exact = sim.position == sim.headerLength;
+
+    switch (sim.opcode) {
+    case SERIALFLASHSIM_CMD_WRITE_ENABLE:
+        sim.sr1 |= SERIALFLASHSIM_SR1_WEL;
+        return exact;
+    case SERIALFLASHSIM_CMD_WRITE_DISABLE:
+        sim.sr1 &= ~SERIALFLASHSIM_SR1_WEL;
+        return exact;
+    case SERIALFLASHSIM_CMD_POWER_DOWN:
+        sim.powerDown = true;
+        return exact;
+    case SERIALFLASHSIM_CMD_RELEASE_POW_DOWN:
+        sim.powerDown = false;
+        return true;
+    case SERIALFLASHSIM_CMD_READ_DATA:
+    case SERIALFLASHSIM_CMD_FAST_READ:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT:
+    case SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO:
+    case SERIALFLASHSIM_CMD_MANUF_DEV_ID:
+    case SERIALFLASHSIM_CMD_UNIQUE_ID:
+    case SERIALFLASHSIM_CMD_READ_STATUS1:
+    case SERIALFLASHSIM_CMD_READ_STATUS2:
+    case SERIALFLASHSIM_CMD_READ_STATUS3:
+    case SERIALFLASHSIM_CMD_READ_SFDP:
+        return header;
+    case SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO:
+        // M5-4 = 10 keeps the chip in continuous read mode, anything else (like the 0xFF mode reset) leaves it
+        if (sim.position > sim.addressBytes + 1) {
+            sim.continuous = (sim.mode & SERIALFLASHSIM_MODE_CONTINUOUS_MASK) == SERIALFLASHSIM_MODE_CONTINUOUS;
+            return header || !sim.continuous;
+        }
+        return false;
+    case SERIALFLASHSIM_CMD_PAGE_PROGRAM:
+    case SERIALFLASHSIM_CMD_QUAD_PAGE_PROGRAM: {
+        if (!header || sim.dataLength == 0 || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+
+        // NOR semantics: programming can only clear bits
+        uint32_t base = sim.address & ~(SERIALFLASH_PAGE_SIZE - 1);
+        for (uint32_t i = 0; i < SERIALFLASH_PAGE_SIZE; i++) {
+            sim.config.memory[base + i] &= sim.page[i];
+        }
+
+        sim.stats.pagePrograms++;
+        sim.stats.bytesProgrammed += (sim.dataLength > SERIALFLASH_PAGE_SIZE) ? SERIALFLASH_PAGE_SIZE : sim.dataLength;
+        SerialFlashSim_StartBusy(sim.config.pageProgramUs, true);
+        return true;
+    }
+    case SERIALFLASHSIM_CMD_SECTOR_ERASE:
+        if (!exact || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.stats.sectorErases++;
+        SerialFlashSim_EraseArray(SERIALFLASH_SECTOR_SIZE, sim.config.sectorEraseUs);
+        return true;
+    case SERIALFLASHSIM_CMD_BLOCK32K_ERASE:
+        if (!exact || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.stats.block32kErases++;
+        SerialFlashSim_EraseArray(SERIALFLASH_BLOCK_SIZE / 2, sim.config.block32kEraseUs);
+        return true;
+    case SERIALFLASHSIM_CMD_BLOCK64K_ERASE:
+        if (!exact || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.stats.block64kErases++;
+        SerialFlashSim_EraseArray(SERIALFLASH_BLOCK_SIZE, sim.config.block64kEraseUs);
+        return true;
+    case SERIALFLASHSIM_CMD_CHIP_ERASE:
+    case SERIALFLASHSIM_CMD_CHIP_ERASE_ALT:
+        if (!exact || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.stats.chipErases++;
+        sim.address = 0;
+        SerialFlashSim_EraseArray(sim.config.capacity, sim.config.chipEraseUs);
+        return true;
+    case SERIALFLASHSIM_CMD_WRITE_STATUS1:
+        if (sim.dataLength == 0 || sim.dataLength > 2 || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.sr1 = (sim.sr1 & ~SERIALFLASHSIM_SR1_WRITABLE) | (sim.status[0] & SERIALFLASHSIM_SR1_WRITABLE);
+        if (sim.dataLength == 2) {
+            // SR2 can be written as the second byte
+            sim.sr2 = (sim.sr2 & ~SERIALFLASHSIM_SR2_WRITABLE) | (sim.status[1] & SERIALFLASHSIM_SR2_WRITABLE);
+            sim.sr2 |= sim.status[1] & SERIALFLASHSIM_SR2_OTP;
+        }
+        SerialFlashSim_StartBusy(sim.config.writeStatusUs, false);
+        return true;
+    case SERIALFLASHSIM_CMD_WRITE_STATUS2:
+        if (sim.dataLength != 1 || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.sr2 = (sim.sr2 & ~SERIALFLASHSIM_SR2_WRITABLE) | (sim.status[0] & SERIALFLASHSIM_SR2_WRITABLE);
+        sim.sr2 |= sim.status[0] & SERIALFLASHSIM_SR2_OTP;
+        SerialFlashSim_StartBusy(sim.config.writeStatusUs, false);
+        return true;
+    case SERIALFLASHSIM_CMD_WRITE_STATUS3:
+        if (sim.dataLength != 1 || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.sr3 = (sim.sr3 & ~SERIALFLASHSIM_SR3_WRITABLE) | (sim.status[0] & SERIALFLASHSIM_SR3_WRITABLE);
+        SerialFlashSim_StartBusy(sim.config.writeStatusUs, false);
+        return true;
+    case SERIALFLASHSIM_CMD_GLOBAL_BLOCK_LOCK:
+    case SERIALFLASHSIM_CMD_GLOBAL_BLOCK_UNLOCK:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_LOCK:
+    case SERIALFLASHSIM_CMD_INDIV_BLOCK_UNLOCK:
+        // Block locks are accepted but not modelled
+        if (!exact || !SerialFlashSim_WriteEnabled()) {
+            return false;
+        }
+        sim.sr1 &= ~SERIALFLASHSIM_SR1_WEL;
+        return true;
+    case SERIALFLASHSIM_CMD_ENABLE_RESET:
+        return exact;
+    case SERIALFLASHSIM_CMD_ENTER_4BYTE_MODE:
+        sim.sr3 |= SERIALFLASHSIM_SR3_ADS;
+        return exact;
+    case SERIALFLASHSIM_CMD_EXIT_4BYTE_MODE:
+        sim.sr3 &= ~SERIALFLASHSIM_SR3_ADS;
+        return exact;
+    case SERIALFLASHSIM_CMD_RESET:
+        if (!exact || !sim.resetEnabled) {
+            return false;
+        }
+        // Aborts any embedded operation and clears volatile state
+        sim.busy = false;
+        sim.sr1 &= ~SERIALFLASHSIM_SR1_WEL;
+        sim.sr2 &= ~SERIALFLASHSIM_SR2_SUS;
+        sim.sr3 &= ~SERIALFLASHSIM_SR3_ADS;
+        SerialFlashSim_StartBusy(SERIALFLASHSIM_RESET_TIME_US, false);
+        return true;
+    case SERIALFLASHSIM_CMD_SUSPEND:
+        // Ignored when there is nothing to suspend
+        if (sim.busy && sim.suspendable && !(sim.sr2 & SERIALFLASHSIM_SR2_SUS)) {
+            sim.suspendedPs = sim.busyUntilPs - sim.nowPs;
+            sim.busyPs -= sim.suspendedPs;
+            sim.sr2 |= SERIALFLASHSIM_SR2_SUS;
+            SerialFlashSim_StartBusy(SERIALFLASHSIM_SUSPEND_TIME_US, false);
+        }
+        return exact;
+    case SERIALFLASHSIM_CMD_RESUME:
+        if (sim.sr2 & SERIALFLASHSIM_SR2_SUS) {
+            sim.sr2 &= ~SERIALFLASHSIM_SR2_SUS;
+            sim.busy = true;
+            sim.suspendable = true;
+            sim.busyUntilPs = sim.nowPs + sim.suspendedPs;
+            sim.busyPs += sim.suspendedPs;
+        }
+        return exact;
+    default:
+        return false;
+    }
+}
+
+static int SerialFlashSim_SpiWrite(const uint8_t *data, uint32_t length) {
+    SerialFlashSim_Shift(data, NULL, length, 1);
+    return 0;
+}
+
+static int SerialFlashSim_SpiRead(uint8_t *data, uint32_t length) {
+    SerialFlashSim_Shift(NULL, data, length, 1);
+    return 0;
+}
+
+static int SerialFlashSim_SpiWriteWrite(const uint8_t *data1, uint32_t length1, const uint8_t *data2, uint32_t length2) {
+    SerialFlashSim_Shift(data1, NULL, length1, 1);
+    SerialFlashSim_Shift(data2, NULL, length2, 1);
+    return 0;
+}
+
+static int SerialFlashSim_SpiWriteRead(const uint8_t *data1, uint32_t length1, uint8_t *data2, uint32_t length2) {
+    SerialFlashSim_Shift(data1, NULL, length1, 1);
+    SerialFlashSim_Shift(NULL, data2, length2, 1);
+    return 0;
+}
+
+static int SerialFlashSim_SpiWriteLines(const uint8_t *data, uint32_t length, int lines) {
+    if (lines != 1 && lines != 2 && lines != 4) {
+        return -1;
+    }
+
+    SerialFlashSim_Shift(data, NULL, length, lines);
+    return 0;
+}
+
+static int SerialFlashSim_SpiReadLines(uint8_t *data, uint32_t length, int lines) {
+    if (lines != 1 && lines != 2 && lines != 4) {
+        return -1;
+    }
+
+    SerialFlashSim_Shift(NULL, data, length, lines);
+    return 0;
+}
+
+static void SerialFlashSim_SpiChipSelect(bool select) {
+    if (select == sim.selected) {
+        sim.stats.protocolErrors++;
+        return;
+    }
+
+    if (select) {
+        uint64_t ps = sim.config.transactionNs * SERIALFLASHSIM_PS_PER_NS;
+        sim.busPs += ps;
+        sim.nowPs += ps;
+        SerialFlashSim_Update();
+
+        sim.selected = true;
+        sim.ignored = false;
+        sim.position = 0;
+        sim.address = 0;
+        sim.dataLength = 0;
+
+        if (sim.continuous) {
+            // Implied Fast Read Quad I/O, with the address length of the one that entered the mode
+            sim.opcode = SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO;
+            sim.headerLength = SerialFlashSim_HeaderLength(sim.opcode) + sim.addressBytes - 3;
+            sim.position = 1;
+        }
+        sim.start = sim.position;
+        return;
+    }
+
+    sim.selected = false;
+    if (sim.position == sim.start) {
+        return;
+    }
+
+    sim.stats.transactions++;
+    sim.stats.commands[sim.command]++;
+
+    if (sim.ignored) {
+        if (sim.opcode != SERIALFLASHSIM_CMD_MODE_RESET) {
+            sim.stats.protocolErrors++;
+        }
+        sim.resetEnabled = false;
+        return;
+    }
+
+    bool ok = SerialFlashSim_Execute();
+    if (!ok) {
+        sim.stats.protocolErrors++;
+    }
+
+    // Reset must immediately follow Enable Reset
+    sim.resetEnabled = ok && sim.opcode == SERIALFLASHSIM_CMD_ENABLE_RESET;
+}
+
+static uint32_t SerialFlashSim_GetTimeUs(void) {
+    return (uint32_t)(sim.nowPs / SERIALFLASHSIM_PS_PER_US);
+}
+
+static int SerialFlashSim_SpiTransfer(const struct SerialFlash_Segment *segments, uint32_t count) {
+    int ret = 0;
+
+    SerialFlashSim_SpiChipSelect(true);
+    for (uint32_t i = 0; i < count; i++) {
+        const struct SerialFlash_Segment *segment = &segments[i];
+        if (segment->lines != 1 && segment->lines != 2 && segment->lines != 4) {
+            ret = -1;
+            break;
+        }
+
+        // Dummy clocks leave the lines high
+        SerialFlashSim_Shift(segment->type == SERIALFLASH_SEGMENT_WRITE ? segment->tx : NULL,
+            segment->type == SERIALFLASH_SEGMENT_READ ? segment->rx : NULL, segment->length, segment->lines);
+    }
+    SerialFlashSim_SpiChipSelect(false);
+
+    return ret;
+}
+
+static void SerialFlashSim_DelayUs(int us) {
+    if (us <= 0) {
+        return;
+    }
+
+    uint64_t ps = (uint64_t)us * SERIALFLASHSIM_PS_PER_US;
+    sim.delayPs += ps;
+    sim.nowPs += ps;
+    SerialFlashSim_Update();
+}
+
+const struct SerialFlash_Platform SerialFlashSim_Platform = {
+    .spiWrite = SerialFlashSim_SpiWrite,
+    .spiRead = SerialFlashSim_SpiRead,
+    .spiWriteWrite = SerialFlashSim_SpiWriteWrite,
+    .spiWriteRead = SerialFlashSim_SpiWriteRead,
+    .spiChipSelect = SerialFlashSim_SpiChipSelect,
+    .dataLines = 4,
+    .spiWriteLines = SerialFlashSim_SpiWriteLines,
+    .spiReadLines = SerialFlashSim_SpiReadLines,
+    .delayUs = SerialFlashSim_DelayUs,
+    .getTimeUs = SerialFlashSim_GetTimeUs
+};
+
+const struct SerialFlash_Platform SerialFlashSim_TransferPlatform = {
+    .dataLines = 4,
+    .spiTransfer = SerialFlashSim_SpiTransfer,
+    .delayUs = SerialFlashSim_DelayUs,
+    .getTimeUs = SerialFlashSim_GetTimeUs
+};
+
+void SerialFlashSim_DefaultConfig(struct SerialFlashSim_Config *config, uint8_t *memory, uint32_t capacity) {
+    static const uint8_t uniqueId[8] = { 0xD2, 0x66, 0x38, 0x48, 0x43, 0x2A, 0x17, 0x2D };
+
+    memset(config, 0, sizeof(*config));
+    config->memory = memory;
+    config->capacity = capacity;
+
+    // Device ID is log2(capacity) - 1: 0x13 for 1 MB, ..., 0x17 for 16 MB
+    config->manufId = SERIALFLASH_MANUF_ID_WINBOND;
+    config->devId = 0;
+    for (uint32_t size = capacity; size > 2; size >>= 1) {
+        config->devId++;
+    }
+    memcpy(config->uniqueId, uniqueId, sizeof(uniqueId));
+
+    config->clockHz = SERIALFLASH_CLOCK_FREQ_MAX_MHZ * 1000000u;
+    config->transactionNs = 500;
+
+    config->pageProgramUs = 400;
+    config->sectorEraseUs = 45 * 1000;
+    config->block32kEraseUs = 120 * 1000;
+    config->block64kEraseUs = 150 * 1000;
+    config->chipEraseUs = (capacity >> 20) * 2500 * 1000;
+    config->writeStatusUs = 10 * 1000;
+}
+
+// Smallest unit that fits the time into the count field: (count + 1) * unit >= time
+static uint32_t SerialFlashSim_SfdpTime(uint32_t us, const uint32_t *unitsUs, uint32_t units, int countBits) {
+    uint32_t unit = 0;
+    uint32_t countMax = 1u << countBits;
+    while (unit + 1 < units && (us + unitsUs[unit] - 1) / unitsUs[unit] > countMax) {
+        unit++;
+    }
+
+    uint32_t count = (us + unitsUs[unit] - 1) / unitsUs[unit];
+    count = count < 1 ? 1 : count > countMax ? countMax : count;
+
+    return (count - 1) | (unit << countBits);
+}
+
+// JESD216 SFDP header, one parameter header and the Basic Flash Parameter Table
+static void SerialFlashSim_BuildSfdp(void) {
+    static const uint32_t eraseUnitsUs[4] = { 1000, 16000, 128000, 1000000 };
+    static const uint32_t chipEraseUnitsUs[4] = { 16000, 256000, 4000000, 64000000 };
+    static const uint32_t programUnitsUs[2] = { 8, 64 };
+    const struct SerialFlashSim_Config *config = &sim.config;
+    uint32_t dw[SERIALFLASHSIM_SFDP_BFPT_DWORDS];
+
+    memset(sim.sfdp, 0xFF, sizeof(sim.sfdp));
+    memset(dw, 0, sizeof(dw));
+
+    // "SFDP", revision 1.6, one parameter header
+    BITOPS_WRITE_U32L(sim.sfdp, 0x50444653);
+    sim.sfdp[4] = 6;
+    sim.sfdp[5] = 1;
+    sim.sfdp[6] = 0;
+    sim.sfdp[7] = 0xFF;
+
+    // BFPT parameter header: ID 0xFF00, revision 1.6, length, pointer
+    sim.sfdp[8] = 0x00;
+    sim.sfdp[9] = 6;
+    sim.sfdp[10] = 1;
+    sim.sfdp[11] = SERIALFLASHSIM_SFDP_BFPT_DWORDS;
+    BITOPS_WRITE_U24L(sim.sfdp + 12, SERIALFLASHSIM_SFDP_BFPT);
+    sim.sfdp[15] = 0xFF;
+
+    // 4K erase (0x20), 64 byte write granularity, 3-byte (or 3/4-byte above 16 MB) addresses, 1-1-2, 1-2-2, 1-4-4, 1-1-4 reads
+    bool large = config->capacity > SERIALFLASH_3BYTE_ADDRESS_LIMIT;
+    dw[0] = 0xFF800000 | BITOPS_BIT(22) | BITOPS_BIT(21) | BITOPS_BIT(20) | (large ? BITOPS_BIT(17) : 0) | BITOPS_BIT(16) |
+        (SERIALFLASHSIM_CMD_SECTOR_ERASE << 8) | BITOPS_BIT(2) | 0x01;
+    // Density in bits, as 2^N above 4 Gbit
+    uint32_t densityLog2 = 3;
+    for (uint32_t size = config->capacity; size > 1; size >>= 1) {
+        densityLog2++;
+    }
+    dw[1] = densityLog2 < 32 ? (1ul << densityLog2) - 1 : 0x80000000 | densityLog2;
+    // {dummy clocks:5, mode clocks:3, opcode:8}: 1-4-4 and 1-1-4, then 1-1-2 and 1-2-2
+    dw[2] = 4 | (2 << 5) | (SERIALFLASHSIM_CMD_FAST_READ_QUAD_IO << 8) | (8u << 16) | ((uint32_t)SERIALFLASHSIM_CMD_FAST_READ_QUAD_OUTPUT << 24);
+    dw[3] = 8 | (SERIALFLASHSIM_CMD_FAST_READ_DUAL_OUTPUT << 8) | (4u << 21) | ((uint32_t)SERIALFLASHSIM_CMD_FAST_READ_DUAL_IO << 24);
+    // No 2-2-2 or 4-4-4
+    dw[4] = 0xFFFFFFEE;
+    dw[5] = 0x0000FFFF;
+    dw[6] = 0x0000FFFF;
+    // Erase types {size exponent:8, opcode:8}
+    dw[7] = 12 | (SERIALFLASHSIM_CMD_SECTOR_ERASE << 8) | (15u << 16) | ((uint32_t)SERIALFLASHSIM_CMD_BLOCK32K_ERASE << 24);
+    dw[8] = 16 | (SERIALFLASHSIM_CMD_BLOCK64K_ERASE << 8);
+    // Typical erase times, maximum is 2 * (3 + 1) times that
+    dw[9] = 3 | (SerialFlashSim_SfdpTime(config->sectorEraseUs, eraseUnitsUs, 4, 5) << 4) |
+        (SerialFlashSim_SfdpTime(config->block32kEraseUs, eraseUnitsUs, 4, 5) << 11) |
+        (SerialFlashSim_SfdpTime(config->block64kEraseUs, eraseUnitsUs, 4, 5) << 18);
+    // Program multiplier, 256 byte pages, typical page program and chip erase times
+    dw[10] = 3 | (8 << 4) | (SerialFlashSim_SfdpTime(config->pageProgramUs, programUnitsUs, 2, 5) << 8) |
+        (SerialFlashSim_SfdpTime(config->chipEraseUs, chipEraseUnitsUs, 4, 5) << 24);
+    // Enter 4-byte addressing with 0xB7 (above 16 MB), soft reset with 0x66, 0x99
+    dw[15] = (large ? 1ul << 24 : 0) | (0x10 << 8);
+
+    for (int i = 0; i < SERIALFLASHSIM_SFDP_BFPT_DWORDS; i++) {
+        BITOPS_WRITE_U32L(sim.sfdp + SERIALFLASHSIM_SFDP_BFPT + i * 4, dw[i]);
+    }
+}
+
+bool SerialFlashSim_Init(const struct SerialFlashSim_Config *config) {
+    if (!config->memory || config->clockHz == 0) {
+        return false;
+    }
+
+    // Capacity must be a power of two of at least one 64K block
+    if (config->capacity < SERIALFLASH_BLOCK_SIZE || (config->capacity & (config->capacity - 1)) != 0) {
+        return false;
+    }
+
+    memset(&sim, 0, sizeof(sim));
+    sim.config = *config;
+    SerialFlashSim_BuildSfdp();
+
+    return true;
+}
+
+void SerialFlashSim_SetClock(uint32_t clockHz) {
+    if (clockHz != 0) {
+        sim.config.clockHz = clockHz;
+    }
+}
+
+const struct SerialFlashSim_Stats *SerialFlashSim_GetStats(void) {
+    sim.stats.busTimeNs = sim.busPs / SERIALFLASHSIM_PS_PER_NS;
+    sim.stats.busyTimeNs = sim.busyPs / SERIALFLASHSIM_PS_PER_NS;
+    sim.stats.delayTimeNs = sim.delayPs / SERIALFLASHSIM_PS_PER_NS;
+
+    return &sim.stats;
+}
+
+void SerialFlashSim_ResetStats(void) {
+    memset(&sim.stats, 0, sizeof(sim.stats));
+    sim.busPs = 0;
+    sim.busyPs = 0;
+    sim.delayPs = 0;
+}
+
+uint64_t SerialFlashSim_GetTimeNs(void) {
+    return sim.nowPs / SERIALFLASHSIM_PS_PER_NS;
+}
+
+void SerialFlashSim_AdvanceTime(uint64_t ns) {
+    sim.nowPs += ns * SERIALFLASHSIM_PS_PER_NS;
+    SerialFlashSim_Update();
+}
+
+bool SerialFlashSim_IsBusy(void) {
+    return sim.busy;
+}
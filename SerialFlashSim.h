@@ -0,0 +1,70 @@
+#ifndef SERIALFLASHSIM_H
+#define SERIALFLASHSIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// In-memory W25Qxx/ZB25VQxx chip simulator with a timing model.
+// Platform callbacks carry no context, so the simulated chip is a singleton.
+// Time is virtual: it advances with SPI clocks, CS transactions and delayUs() calls.
+// Chips above 16 MB accept 4-Byte Address Mode and the dedicated 4-byte instructions.
+
+struct SerialFlashSim_Config {
+    uint8_t *memory; // Chip contents, capacity bytes
+    uint32_t capacity;
+
+    uint8_t manufId;
+    uint8_t devId;
+    uint8_t uniqueId[8];
+
+    uint32_t clockHz; // SPI clock
+    uint32_t transactionNs; // CS toggle and driver overhead per transaction
+
+    uint32_t pageProgramUs;
+    uint32_t sectorEraseUs;
+    uint32_t block32kEraseUs;
+    uint32_t block64kEraseUs;
+    uint32_t chipEraseUs;
+    uint32_t writeStatusUs;
+};
+
+struct SerialFlashSim_Stats {
+    uint64_t clockCycles; // SPI clock cycles
+    uint64_t busTimeNs; // Time spent shifting data and toggling CS
+    uint64_t busyTimeNs; // Time the chip spent in embedded operations
+    uint64_t delayTimeNs; // Time spent in delayUs()
+
+    uint32_t transactions; // CS frames
+    uint32_t commands[256]; // Frames per opcode
+
+    uint32_t bytesRead; // Array bytes read
+    uint32_t bytesProgrammed; // Array bytes programmed
+
+    uint32_t pagePrograms;
+    uint32_t sectorErases;
+    uint32_t block32kErases;
+    uint32_t block64kErases;
+    uint32_t chipErases;
+
+    uint32_t protocolErrors; // Commands ignored by the chip (no WEL, busy, malformed, ...)
+};
+
+// Typical W25Q timings at 50 MHz, memory is filled by the caller
+void SerialFlashSim_DefaultConfig(struct SerialFlashSim_Config *config, uint8_t *memory, uint32_t capacity);
+
+bool SerialFlashSim_Init(const struct SerialFlashSim_Config *config);
+void SerialFlashSim_SetClock(uint32_t clockHz);
+
+const struct SerialFlashSim_Stats *SerialFlashSim_GetStats(void);
+void SerialFlashSim_ResetStats(void);
+
+uint64_t SerialFlashSim_GetTimeNs(void);
+void SerialFlashSim_AdvanceTime(uint64_t ns);
+bool SerialFlashSim_IsBusy(void);
+
+extern const struct SerialFlash_Platform SerialFlashSim_Platform;
+// Same chip behind a single spiTransfer() callback
+extern const struct SerialFlash_Platform SerialFlashSim_TransferPlatform;
+
+#endif // SERIALFLASHSIM_H
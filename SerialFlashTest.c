@@ -0,0 +1,404 @@
+// Regression tests of the storage modules on the simulator, mostly for power loss.
+// Torn operations are reproduced by editing the simulated memory directly: a torn erase
+// leaves a blank header over programmed data, a torn program leaves part of a frame blank.
+//
+// Build: cc -std=c99 -O2 SerialFlashTest.c SerialFlash.c SerialFlashSim.c SerialFlashKV.c SerialFlashLog.c SerialFlashBuffer.c SerialFlashCache.c SerialFlashSched.c SerialFlashVolume.c -o SerialFlashTest
+// Exits with 1 if any test failed.
+
+#include <stdio.h>
+#include <string.h>
+#include "SerialFlash.h"
+#include "SerialFlashSim.h"
+#include "SerialFlashKV.h"
+#include "SerialFlashLog.h"
+#include "SerialFlashBuffer.h"
+#include "SerialFlashCache.h"
+#include "SerialFlashSched.h"
+#include "SerialFlashVolume.h"
+
+#define SERIALFLASHTEST_CAPACITY (1ul * 1024 * 1024)
+#define SERIALFLASHTEST_TIMEOUT_MS 5000
+
+static uint8_t SerialFlashTest_Memory[SERIALFLASHTEST_CAPACITY];
+static struct SerialFlash_State SerialFlashTest_State;
+static struct SerialFlash_Platform SerialFlashTest_Platform;
+
+static int (*SerialFlashTest_Transfer)(const struct SerialFlash_Segment *segments, uint32_t count);
+static uint32_t SerialFlashTest_FailPrograms; // Page programs to refuse
+static uint32_t SerialFlashTest_BusyReads; // SR1 reads to report busy
+static uint32_t SerialFlashTest_FailReads; // SR1 reads to fail
+
+// Transfer platform that fails the next page programs before the chip sees them
+// and the next SR1 reads, or reports them busy, as a chip taking longer to suspend
+static int SerialFlashTest_FailingTransfer(const struct SerialFlash_Segment *segments, uint32_t count) {
+    if (SerialFlashTest_FailPrograms > 0 && segments[0].type == SERIALFLASH_SEGMENT_WRITE && segments[0].tx[0] == 0x02) {
+        SerialFlashTest_FailPrograms--;
+        return -1;
+    }
+    if (SerialFlashTest_FailReads > 0 && count == 2 && segments[0].tx[0] == 0x05) {
+        SerialFlashTest_FailReads--;
+        return -1;
+    }
+
+    int ret = SerialFlashTest_Transfer(segments, count);
+    if (!ret && SerialFlashTest_BusyReads > 0 && count == 2 && segments[0].tx[0] == 0x05) {
+        SerialFlashTest_BusyReads--;
+        segments[1].rx[0] |= SERIALFLASH_SR1_BUSY;
+    }
+
+    return ret;
+}
+
+static void SerialFlashTest_Init(void) {
+    struct SerialFlashSim_Config config;
+    memset(SerialFlashTest_Memory, 0xFF, sizeof(SerialFlashTest_Memory));
+    SerialFlashSim_DefaultConfig(&config, SerialFlashTest_Memory, SERIALFLASHTEST_CAPACITY);
+    SerialFlashSim_Init(&config);
+
+    SerialFlash_InitState(&SerialFlashTest_State, SERIALFLASH_POLL_ADAPTIVE);
+    SerialFlashTest_Platform = SerialFlashSim_TransferPlatform;
+    SerialFlashTest_Platform.state = &SerialFlashTest_State;
+    SerialFlashTest_Transfer = SerialFlashSim_TransferPlatform.spiTransfer;
+    SerialFlashTest_Platform.spiTransfer = SerialFlashTest_FailingTransfer;
+    SerialFlashTest_FailPrograms = 0;
+    SerialFlashTest_BusyReads = 0;
+    SerialFlashTest_FailReads = 0;
+}
+
+// Leftover of an erase cut short: header blank, body still programmed
+static void SerialFlashTest_TearErase(uint32_t address, uint32_t headerSize) {
+    memset(&SerialFlashTest_Memory[address], 0xFF, headerSize);
+    for (uint32_t i = headerSize; i < SERIALFLASH_SECTOR_SIZE; i += 3) {
+        SerialFlashTest_Memory[address + i] = (uint8_t)(i * 7);
+    }
+}
+
+static void SerialFlashTest_Value(uint32_t key, uint8_t *value, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        value[i] = (uint8_t)(key * 31 + i);
+    }
+}
+
+// Mount after a torn erase of a free sector, the sets that land there must read back
+static bool SerialFlashTest_KVTornErase(void) {
+    static struct SerialFlashKV_Entry index[64];
+    struct SerialFlashKV kv;
+    uint8_t value[200], read[200];
+    uint32_t length;
+
+    SerialFlashTest_Init();
+    if (!SerialFlashKV_Format(&kv, &SerialFlashTest_Platform, 0, 4, index, 64, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+    for (uint32_t sector = 1; sector < 4; sector++) {
+        SerialFlashTest_TearErase(sector * SERIALFLASH_SECTOR_SIZE, SERIALFLASHKV_HEADER_SIZE);
+    }
+    if (!SerialFlashKV_Mount(&kv, &SerialFlashTest_Platform, 0, 4, index, 64, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+
+    for (uint32_t key = 0; key < 30; key++) {
+        SerialFlashTest_Value(key, value, sizeof(value));
+        if (!SerialFlashKV_Set(&kv, key, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+
+    for (uint32_t key = 0; key < 30; key++) {
+        SerialFlashTest_Value(key, value, sizeof(value));
+        if (!SerialFlashKV_Get(&kv, key, read, sizeof(read), &length, SERIALFLASHTEST_TIMEOUT_MS) ||
+            length != sizeof(value) || memcmp(read, value, sizeof(value)) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Reads the whole log back, the records must be those of SerialFlashTest_Value() for the listed keys in order
+static bool SerialFlashTest_LogCheck(const struct SerialFlashLog *log, const uint32_t *keys, uint32_t count, uint32_t recordLength) {
+    struct SerialFlashLog_Cursor cursor;
+    uint8_t value[SERIALFLASH_PAGE_SIZE], read[SERIALFLASH_PAGE_SIZE];
+    uint32_t length;
+
+    SerialFlashLog_Rewind(log, &cursor);
+    for (uint32_t i = 0; i < count; i++) {
+        SerialFlashTest_Value(keys[i], value, recordLength);
+        if (!SerialFlashLog_Next(log, &cursor, read, sizeof(read), &length, SERIALFLASHTEST_TIMEOUT_MS) ||
+            length != recordLength || memcmp(read, value, recordLength) != 0) {
+            return false;
+        }
+    }
+
+    return !SerialFlashLog_Next(log, &cursor, read, sizeof(read), &length, SERIALFLASHTEST_TIMEOUT_MS);
+}
+
+// Mount after a torn erase ahead, the appends that land in that sector must read back
+static bool SerialFlashTest_LogTornEraseAhead(void) {
+    struct SerialFlashLog log;
+    uint8_t value[60];
+    uint32_t keys[100];
+
+    SerialFlashTest_Init();
+    if (!SerialFlashLog_Format(&log, &SerialFlashTest_Platform, 0, 4, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+    SerialFlashTest_TearErase(SERIALFLASH_SECTOR_SIZE, SERIALFLASHLOG_HEADER_SIZE);
+    if (!SerialFlashLog_Mount(&log, &SerialFlashTest_Platform, 0, 4, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+
+    for (uint32_t key = 0; key < 100; key++) {
+        SerialFlashTest_Value(key, value, sizeof(value));
+        if (!SerialFlashLog_Append(&log, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS)) {
+            return false;
+        }
+        keys[key] = key;
+    }
+
+    return SerialFlashTest_LogCheck(&log, keys, 100, sizeof(value));
+}
+
+// A torn append (data partly programmed) and a failed one are skipped, the appends after them read back
+static bool SerialFlashTest_LogTornAppend(void) {
+    struct SerialFlashLog log;
+    uint8_t value[40];
+    static const uint32_t keys[] = { 0, 3, 4 };
+
+    SerialFlashTest_Init();
+    if (!SerialFlashLog_Format(&log, &SerialFlashTest_Platform, 0, 4, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+
+    for (uint32_t key = 0; key < 5; key++) {
+        SerialFlashTest_Value(key, value, sizeof(value));
+        SerialFlashTest_FailPrograms = key == 2 ? 1 : 0;
+
+        uint32_t offset = log.writeOffset;
+        bool ok = SerialFlashLog_Append(&log, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS);
+        if (ok != (key != 2)) {
+            return false;
+        }
+
+        if (key == 1) {
+            // Torn at the end of the data, then remounted
+            SerialFlashTest_Memory[offset + SERIALFLASHLOG_RECORD_HEADER_SIZE + sizeof(value) - 1] = 0xFF;
+            if (!SerialFlashLog_Mount(&log, &SerialFlashTest_Platform, 0, 4, SERIALFLASHTEST_TIMEOUT_MS)) {
+                return false;
+            }
+        }
+    }
+
+    if (!SerialFlashTest_LogCheck(&log, keys, 3, sizeof(value))) {
+        return false;
+    }
+
+    return SerialFlashLog_Mount(&log, &SerialFlashTest_Platform, 0, 4, SERIALFLASHTEST_TIMEOUT_MS) &&
+        SerialFlashTest_LogCheck(&log, keys, 3, sizeof(value));
+}
+
+// A page whose program failed stays pending: reads still see it and the next flush programs it
+static bool SerialFlashTest_BufferFailedFlush(void) {
+    struct SerialFlashBuffer buffer;
+    uint8_t value[100], other[100], read[100];
+
+    SerialFlashTest_Init();
+    SerialFlashBuffer_Init(&buffer, &SerialFlashTest_Platform, NULL, 0);
+    SerialFlashTest_Value(1, value, sizeof(value));
+    SerialFlashTest_Value(2, other, sizeof(other));
+
+    if (!SerialFlashBuffer_Write(&buffer, 10, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+    SerialFlashTest_FailPrograms = 1;
+    if (SerialFlashBuffer_Flush(&buffer, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+    if (!SerialFlashBuffer_Read(&buffer, 10, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) || memcmp(read, value, sizeof(value)) != 0) {
+        return false;
+    }
+
+    // Leaving the page flushes it again
+    if (!SerialFlashBuffer_Write(&buffer, SERIALFLASH_PAGE_SIZE + 10, other, sizeof(other), SERIALFLASHTEST_TIMEOUT_MS) ||
+        !SerialFlashBuffer_Barrier(&buffer, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+
+    return memcmp(&SerialFlashTest_Memory[10], value, sizeof(value)) == 0 &&
+        memcmp(&SerialFlashTest_Memory[SERIALFLASH_PAGE_SIZE + 10], other, sizeof(other)) == 0;
+}
+
+static uint32_t SerialFlashTest_Modified; // Calls of the user modify hook
+
+static void SerialFlashTest_ModifyHook(void *context, uint32_t address, uint32_t length) {
+    (void)context;
+    (void)address;
+    (void)length;
+    SerialFlashTest_Modified++;
+}
+
+// A program whose completion couldn't be checked fails one barrier, not the writes after it
+static bool SerialFlashTest_BufferFailedCompletion(void) {
+    struct SerialFlashBuffer buffer;
+    uint8_t value[SERIALFLASH_PAGE_SIZE];
+
+    SerialFlashTest_Init();
+    SerialFlashBuffer_Init(&buffer, &SerialFlashTest_Platform, NULL, 0);
+    SerialFlashTest_Value(1, value, sizeof(value));
+
+    // A full page goes out at once, its wait sees the status read fail
+    if (!SerialFlashBuffer_Write(&buffer, 0, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+    SerialFlashTest_FailReads = 1;
+    if (SerialFlashBuffer_Barrier(&buffer, SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+
+    return SerialFlashBuffer_Write(&buffer, SERIALFLASH_PAGE_SIZE, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS) &&
+        SerialFlashBuffer_Barrier(&buffer, SERIALFLASHTEST_TIMEOUT_MS) &&
+        memcmp(&SerialFlashTest_Memory[SERIALFLASH_PAGE_SIZE], value, sizeof(value)) == 0;
+}
+
+// Two caches and a user modify hook on one state: writes invalidate both caches and reach the user hook,
+// deinit unlinks a cache from the middle of the chain
+static bool SerialFlashTest_CacheChainedHooks(void) {
+    static uint32_t pools[2][SERIALFLASHCACHE_POOL_SIZE(SERIALFLASH_PAGE_SIZE, 4) / sizeof(uint32_t)];
+    struct SerialFlashCache first, second;
+    uint8_t value[16], read[16];
+
+    SerialFlashTest_Init();
+    SerialFlashTest_State.modifyHook = SerialFlashTest_ModifyHook;
+    SerialFlashTest_Modified = 0;
+    if (!SerialFlashCache_Init(&first, &SerialFlashTest_Platform, SERIALFLASHCACHE_LRU, SERIALFLASH_PAGE_SIZE, pools[0], sizeof(pools[0])) ||
+        !SerialFlashCache_Init(&second, &SerialFlashTest_Platform, SERIALFLASHCACHE_LRU, SERIALFLASH_PAGE_SIZE, pools[1], sizeof(pools[1]))) {
+        return false;
+    }
+
+    // Fill both caches with the erased page, then program it
+    SerialFlashTest_Value(1, value, sizeof(value));
+    if (!SerialFlashCache_Read(&first, 0, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) ||
+        !SerialFlashCache_Read(&second, 0, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) ||
+        !SerialFlash_Write(&SerialFlashTest_Platform, 0, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS) ||
+        SerialFlashTest_Modified != 1) {
+        return false;
+    }
+    if (!SerialFlashCache_Read(&first, 0, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) || memcmp(read, value, sizeof(value)) != 0 ||
+        !SerialFlashCache_Read(&second, 0, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) || memcmp(read, value, sizeof(value)) != 0) {
+        return false;
+    }
+
+    // The first cache sits behind the second one
+    SerialFlashCache_Deinit(&first);
+    SerialFlashTest_Value(2, value, sizeof(value));
+    if (!SerialFlash_Erase(&SerialFlashTest_Platform, 0, SERIALFLASH_SECTOR_SIZE, SERIALFLASHTEST_TIMEOUT_MS) ||
+        !SerialFlash_Write(&SerialFlashTest_Platform, 0, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS) ||
+        SerialFlashTest_Modified != 3 ||
+        !SerialFlashCache_Read(&second, 0, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) || memcmp(read, value, sizeof(value)) != 0) {
+        return false;
+    }
+
+    SerialFlashCache_Deinit(&second);
+    return SerialFlashTest_State.modifyHook == SerialFlashTest_ModifyHook;
+}
+
+// A write gathered into the page program of a higher priority one must not overtake a read queued before it
+static bool SerialFlashTest_SchedGatherOrder(void) {
+    struct SerialFlashSched sched;
+    struct SerialFlashSched_Request first, read, write;
+    uint8_t firstData[16], writeData[16], readData[16], blank[16];
+
+    SerialFlashTest_Init();
+    SerialFlashSched_Init(&sched, &SerialFlashTest_Platform, SERIALFLASHTEST_TIMEOUT_MS);
+    memset(firstData, 0x11, sizeof(firstData));
+    memset(writeData, 0x22, sizeof(writeData));
+    memset(blank, 0xFF, sizeof(blank));
+
+    if (!SerialFlashSched_Write(&sched, &first, 0, firstData, sizeof(firstData), 5, NULL, NULL) ||
+        !SerialFlashSched_Read(&sched, &read, 16, readData, sizeof(readData), 1, NULL, NULL) ||
+        !SerialFlashSched_Write(&sched, &write, 16, writeData, sizeof(writeData), 1, NULL, NULL)) {
+        return false;
+    }
+    if (!SerialFlashSched_Wait(&sched, &write, SERIALFLASHTEST_TIMEOUT_MS) ||
+        first.state != SERIALFLASHSCHED_DONE || read.state != SERIALFLASHSCHED_DONE) {
+        return false;
+    }
+
+    return memcmp(readData, blank, sizeof(blank)) == 0 &&
+        memcmp(&SerialFlashTest_Memory[0], firstData, sizeof(firstData)) == 0 &&
+        memcmp(&SerialFlashTest_Memory[16], writeData, sizeof(writeData)) == 0;
+}
+
+// A failed volume write doesn't fail the writes after it
+static bool SerialFlashTest_VolumeFailedWrite(void) {
+    struct SerialFlashVolume_Chip chips[1] = { { .platform = &SerialFlashTest_Platform } };
+    struct SerialFlashVolume volume;
+    uint8_t value[100];
+
+    SerialFlashTest_Init();
+    if (!SerialFlashVolume_Init(&volume, chips, 1, SERIALFLASH_SECTOR_SIZE)) {
+        return false;
+    }
+
+    SerialFlashTest_Value(1, value, sizeof(value));
+    SerialFlashTest_FailPrograms = 1;
+    if (SerialFlashVolume_Write(&volume, 0, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS)) {
+        return false;
+    }
+
+    return SerialFlashVolume_Write(&volume, SERIALFLASH_SECTOR_SIZE, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS) &&
+        memcmp(&SerialFlashTest_Memory[SERIALFLASH_SECTOR_SIZE], value, sizeof(value)) == 0;
+}
+
+// A suspend taking effect only after tSUS still gets its resume, the erase completes
+static bool SerialFlashTest_ReadPreemptLateSuspend(void) {
+    uint8_t value[16], read[16];
+
+    SerialFlashTest_Init();
+    SerialFlashTest_Value(1, value, sizeof(value));
+    if (!SerialFlash_Write(&SerialFlashTest_Platform, 0, value, sizeof(value), SERIALFLASHTEST_TIMEOUT_MS) ||
+        !SerialFlash_SetWriteEnable(&SerialFlashTest_Platform, true) ||
+        !SerialFlash_SectorErase(&SerialFlashTest_Platform, SERIALFLASH_SECTOR_SIZE)) {
+        return false;
+    }
+
+    // Busy anyway before the suspend, then still busy after tSUS
+    SerialFlashTest_BusyReads = 2;
+    if (!SerialFlash_ReadPreempt(&SerialFlashTest_Platform, 0, read, sizeof(read), SERIALFLASHTEST_TIMEOUT_MS) ||
+        memcmp(read, value, sizeof(value)) != 0) {
+        return false;
+    }
+
+    uint8_t sr2;
+    return SerialFlash_ReadStatus(&SerialFlashTest_Platform, SERIALFLASH_SR2, &sr2) && !(sr2 & SERIALFLASH_SR2_SUS) &&
+        SerialFlash_WaitBusy(&SerialFlashTest_Platform, SERIALFLASHTEST_TIMEOUT_MS) &&
+        SerialFlash_IsBlank(&SerialFlashTest_Platform, SERIALFLASH_SECTOR_SIZE, SERIALFLASH_SECTOR_SIZE, SERIALFLASHTEST_TIMEOUT_MS);
+}
+
+struct SerialFlashTest_Case {
+    const char *name;
+    bool (*run)(void);
+};
+
+static const struct SerialFlashTest_Case SerialFlashTest_Cases[] = {
+    { "kv_torn_erase", SerialFlashTest_KVTornErase },
+    { "log_torn_erase_ahead", SerialFlashTest_LogTornEraseAhead },
+    { "log_torn_append", SerialFlashTest_LogTornAppend },
+    { "buffer_failed_flush", SerialFlashTest_BufferFailedFlush },
+    { "buffer_failed_completion", SerialFlashTest_BufferFailedCompletion },
+    { "cache_chained_hooks", SerialFlashTest_CacheChainedHooks },
+    { "sched_gather_order", SerialFlashTest_SchedGatherOrder },
+    { "volume_failed_write", SerialFlashTest_VolumeFailedWrite },
+    { "read_preempt_late_suspend", SerialFlashTest_ReadPreemptLateSuspend },
+};
+
+int main(void) {
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(SerialFlashTest_Cases) / sizeof(SerialFlashTest_Cases[0]); i++) {
+        bool ok = SerialFlashTest_Cases[i].run();
+        printf("%s %s\n", ok ? "PASS" : "FAIL", SerialFlashTest_Cases[i].name);
+        failed += !ok;
+    }
+
+    return failed ? 1 : 0;
+}
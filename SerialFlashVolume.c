@@ -0,0 +1,205 @@
+#include "SerialFlashVolume.h"
+
+bool SerialFlashVolume_Init(struct SerialFlashVolume *volume, struct SerialFlashVolume_Chip *chips, uint32_t chipCount, uint32_t stripeSize) {
+    if (chipCount == 0 || stripeSize < SERIALFLASH_PAGE_SIZE || (stripeSize & (stripeSize - 1)) != 0) {
+        return false;
+    }
+
+    uint32_t chipCapacity = 0;
+    for (uint32_t i = 0; i < chipCount; i++) {
+        uint32_t capacity;
+        if (!SerialFlash_ReadCapacity(chips[i].platform, &capacity)) {
+            return false;
+        }
+        if (i > 0 && capacity != chipCapacity) {
+            return false;
+        }
+        chipCapacity = capacity;
+
+        chips[i].job.state = SERIALFLASH_JOB_DONE;
+    }
+
+    if (chipCapacity % stripeSize != 0 || chipCapacity > UINT32_MAX / chipCount) {
+        return false;
+    }
+
+    volume->chips = chips;
+    volume->chipCount = chipCount;
+    volume->chipCapacity = chipCapacity;
+    volume->stripeSize = stripeSize;
+    volume->capacity = chipCapacity * chipCount;
+
+    return true;
+}
+
+uint32_t SerialFlashVolume_EraseSize(const struct SerialFlashVolume *volume) {
+    return volume->stripeSize >= SERIALFLASH_SECTOR_SIZE ? SERIALFLASH_SECTOR_SIZE : SERIALFLASH_SECTOR_SIZE * volume->chipCount;
+}
+
+static bool SerialFlashVolume_CheckRange(const struct SerialFlashVolume *volume, uint32_t address, uint32_t length) {
+    return address <= volume->capacity && length <= volume->capacity - address;
+}
+
+// Address on the chip of the first byte at or after the volume address that the chip holds
+static uint32_t SerialFlashVolume_ChipAddress(const struct SerialFlashVolume *volume, uint32_t chip, uint32_t address) {
+    uint32_t stripe = address / volume->stripeSize;
+    uint32_t row = stripe / volume->chipCount;
+    uint32_t owner = stripe % volume->chipCount;
+
+    if (chip == owner) {
+        return row * volume->stripeSize + address % volume->stripeSize;
+    }
+
+    // Chips before the owner already had their stripe of this row
+    return (chip < owner ? row + 1 : row) * volume->stripeSize;
+}
+
+// Volume address of the first byte at or after the volume address that the chip holds
+static uint32_t SerialFlashVolume_FirstAddress(const struct SerialFlashVolume *volume, uint32_t chip, uint32_t address) {
+    uint32_t stripe = address / volume->stripeSize;
+    uint32_t row = stripe / volume->chipCount;
+    uint32_t owner = stripe % volume->chipCount;
+
+    if (chip == owner) {
+        return address;
+    }
+
+    return ((chip < owner ? row + 1 : row) * volume->chipCount + chip) * volume->stripeSize;
+}
+
+// Polls the chip jobs together, starting the next stripe piece of a write on a chip as soon as its job is done.
+// The timeout is counted while no chip makes progress.
+static bool SerialFlashVolume_Run(struct SerialFlashVolume *volume, uint32_t address, uint32_t end, const uint8_t *buffer, uint32_t timeout_ms) {
+    uint32_t timeoutUs = timeout_ms * 1000;
+    uint32_t idleUs = 0;
+    bool ok = true;
+
+    for (;;) {
+        bool active = false;
+        bool progress = false;
+
+        for (uint32_t i = 0; i < volume->chipCount; i++) {
+            struct SerialFlashVolume_Chip *chip = &volume->chips[i];
+
+            if (chip->job.state == SERIALFLASH_JOB_RUNNING) {
+                uint32_t before = chip->job.address;
+                bool running = SerialFlash_PollJob(&chip->job);
+
+                progress |= chip->job.address != before || !running;
+                if (running) {
+                    active = true;
+                    continue;
+                }
+            }
+
+            if (chip->job.state == SERIALFLASH_JOB_FAILED) {
+                ok = false;
+            }
+
+            // Next piece: up to the end of the stripe, the rest of the data goes to the other chips
+            if (!ok || chip->next >= end) {
+                continue;
+            }
+
+            uint32_t pieceEnd = (chip->next / volume->stripeSize + 1) * volume->stripeSize;
+            if (pieceEnd > end) {
+                pieceEnd = end;
+            }
+
+            SerialFlash_StartWrite(&chip->job, chip->platform, SerialFlashVolume_ChipAddress(volume, i, chip->next),
+                buffer + (chip->next - address), pieceEnd - chip->next, NULL, NULL);
+            chip->next = (chip->next / volume->stripeSize + volume->chipCount) * volume->stripeSize;
+
+            SerialFlash_PollJob(&chip->job);
+            active = true;
+            progress = true;
+        }
+
+        if (!active) {
+            return ok;
+        }
+
+        if (progress) {
+            idleUs = 0;
+        } else if (idleUs >= timeoutUs) {
+            // Don't issue any more commands for this call
+            for (uint32_t i = 0; i < volume->chipCount; i++) {
+                if (volume->chips[i].job.state == SERIALFLASH_JOB_RUNNING) {
+                    volume->chips[i].job.state = SERIALFLASH_JOB_FAILED;
+                }
+            }
+            return false;
+        }
+
+        // All chips busy
+        volume->chips[0].platform->delayUs(SERIALFLASH_JOB_POLL_US);
+        idleUs += SERIALFLASH_JOB_POLL_US;
+    }
+}
+
+bool SerialFlashVolume_Read(const struct SerialFlashVolume *volume, uint32_t address, uint8_t *buffer, uint32_t length, uint32_t timeout_ms) {
+    if (!SerialFlashVolume_CheckRange(volume, address, length)) {
+        return false;
+    }
+
+    // Stripe by stripe, a read is not worth splitting between the chips
+    uint32_t end = address + length;
+    for (uint32_t cur = address; cur < end; ) {
+        uint32_t chip = cur / volume->stripeSize % volume->chipCount;
+        uint32_t pieceEnd = (cur / volume->stripeSize + 1) * volume->stripeSize;
+        if (pieceEnd > end) {
+            pieceEnd = end;
+        }
+
+        if (!SerialFlash_Read(volume->chips[chip].platform, SerialFlashVolume_ChipAddress(volume, chip, cur),
+                buffer + (cur - address), pieceEnd - cur, timeout_ms)) {
+            return false;
+        }
+
+        cur = pieceEnd;
+    }
+
+    return true;
+}
+
+bool SerialFlashVolume_Write(struct SerialFlashVolume *volume, uint32_t address, const uint8_t *buffer, uint32_t length, uint32_t timeout_ms) {
+    if (!SerialFlashVolume_CheckRange(volume, address, length)) {
+        return false;
+    }
+
+    // A job failed by an earlier call is not carried over
+    for (uint32_t i = 0; i < volume->chipCount; i++) {
+        volume->chips[i].job.state = SERIALFLASH_JOB_IDLE;
+        volume->chips[i].next = SerialFlashVolume_FirstAddress(volume, i, address);
+    }
+
+    return SerialFlashVolume_Run(volume, address, address + length, buffer, timeout_ms);
+}
+
+bool SerialFlashVolume_Erase(struct SerialFlashVolume *volume, uint32_t address, uint32_t length, uint32_t timeout_ms) {
+    uint32_t eraseSize = SerialFlashVolume_EraseSize(volume);
+    if (!SerialFlashVolume_CheckRange(volume, address, length) || address % eraseSize != 0 || length % eraseSize != 0) {
+        return false;
+    }
+
+    // The stripes of a chip in the range are contiguous on the chip, one erase job per chip
+    uint32_t end = address + length;
+    for (uint32_t i = 0; i < volume->chipCount; i++) {
+        struct SerialFlashVolume_Chip *chip = &volume->chips[i];
+        uint32_t chipStart = SerialFlashVolume_ChipAddress(volume, i, address);
+        uint32_t chipEnd = SerialFlashVolume_ChipAddress(volume, i, end);
+
+        chip->next = end;
+        chip->job.state = SERIALFLASH_JOB_IDLE;
+        if (chipStart < chipEnd &&
+            !SerialFlash_StartErase(&chip->job, chip->platform, chipStart, chipEnd - chipStart, NULL, NULL)) {
+            // Jobs do nothing until polled, drop the ones already started
+            for (uint32_t j = 0; j < i; j++) {
+                volume->chips[j].job.state = SERIALFLASH_JOB_DONE;
+            }
+            return false;
+        }
+    }
+
+    return SerialFlashVolume_Run(volume, address, end, NULL, timeout_ms);
+}
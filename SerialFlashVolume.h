@@ -0,0 +1,38 @@
+#ifndef SERIALFLASHVOLUME_H
+#define SERIALFLASHVOLUME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "SerialFlash.h"
+
+// Striped volume (RAID-0) over identical chips on separate chip selects.
+// The volume is cut into stripes of stripeSize bytes dealt to the chips in turn, so chip c
+// holds stripes c, c + N, c + 2N, ... back to back. Writes and erases run as one
+// non-blocking job per chip and wait on all chips together, the busy times overlap.
+
+struct SerialFlashVolume_Chip {
+    const struct SerialFlash_Platform *platform; // Set by the caller
+    struct SerialFlash_Job job;
+    uint32_t next; // Volume address of the next stripe piece to write
+};
+
+struct SerialFlashVolume {
+    struct SerialFlashVolume_Chip *chips;
+    uint32_t chipCount;
+    uint32_t chipCapacity;
+    uint32_t stripeSize; // Power of two, at least SERIALFLASH_PAGE_SIZE
+    uint32_t capacity;
+};
+
+// Reads the capacity of every chip, they must match
+bool SerialFlashVolume_Init(struct SerialFlashVolume *volume, struct SerialFlashVolume_Chip *chips, uint32_t chipCount, uint32_t stripeSize);
+
+// Erase address and length must be multiples of this: a sector of every chip for stripes below a sector
+uint32_t SerialFlashVolume_EraseSize(const struct SerialFlashVolume *volume);
+
+bool SerialFlashVolume_Read(const struct SerialFlashVolume *volume, uint32_t address, uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+// Target range must be erased, as for SerialFlash_Write()
+bool SerialFlashVolume_Write(struct SerialFlashVolume *volume, uint32_t address, const uint8_t *buffer, uint32_t length, uint32_t timeout_ms);
+bool SerialFlashVolume_Erase(struct SerialFlashVolume *volume, uint32_t address, uint32_t length, uint32_t timeout_ms);
+
+#endif // SERIALFLASHVOLUME_H